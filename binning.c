@@ -0,0 +1,154 @@
+#include "binning.h"
+#include "ising.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static void *allocateOrDie(size_t count, size_t size)
+{
+    void *pointer = calloc(count, size);
+    if (!pointer) {
+        fprintf(stderr, "Error allocating binning buffers, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+void binningInit(binning_t *binning, int observable_count, int max_bins)
+{
+    if (max_bins < 2 || max_bins % 2) {
+        fprintf(stderr, "the number of bins must be even and at least 2, got %d\n", max_bins);
+        exit(EXIT_FAILURE);
+    }
+    *binning = (binning_t) {
+        .observable_count = observable_count, .max_bins = max_bins,
+        .bin_count = 0, .block_size = 1, .in_block = 0, .samples = 0,
+        .bins = allocateOrDie((size_t)max_bins * observable_count, sizeof(complex double)),
+        .partial = allocateOrDie(observable_count, sizeof(complex double)),
+        .total = allocateOrDie(observable_count, sizeof(complex double)),
+    };
+}
+
+void binningFree(binning_t *binning)
+{
+    free(binning->bins);
+    free(binning->partial);
+    free(binning->total);
+}
+
+void binningAdd(binning_t *binning, const complex double *sample)
+{
+    int count = binning->observable_count;
+    for (int i = 0; i < count; i++) {
+        binning->partial[i] += sample[i];
+        binning->total[i] += sample[i];
+    }
+    binning->samples++;
+    if (++binning->in_block < binning->block_size)
+        return;
+
+    complex double *bin = binning->bins + (size_t)binning->bin_count * count;
+    for (int i = 0; i < count; i++)
+        bin[i] = binning->partial[i] / binning->block_size;
+    memset(binning->partial, 0, count * sizeof(complex double));
+    binning->in_block = 0;
+
+    if (++binning->bin_count < binning->max_bins)
+        return;
+
+    // out of room, so halve the number of bins by merging neighbours
+    for (int b = 0; b < binning->max_bins / 2; b++) {
+        complex double *merged = binning->bins + (size_t)b * count;
+        complex double *first  = binning->bins + (size_t)(2 * b) * count;
+        complex double *second = binning->bins + (size_t)(2 * b + 1) * count;
+        for (int i = 0; i < count; i++)
+            merged[i] = (first[i] + second[i]) / 2;
+    }
+    binning->bin_count = binning->max_bins / 2;
+    binning->block_size *= 2;
+}
+
+void binningMean(binning_t *binning, complex double *mean)
+{
+    for (int i = 0; i < binning->observable_count; i++)
+        mean[i] = binning->total[i] / binning->samples;
+}
+
+// welford's algo on complex values, the variance is of the magnitude of the deviation
+static inline void welfordUpdate(complex double *mean, double *m2, complex double value, unsigned long n)
+{
+    complex double delta = value - *mean;
+    *mean += delta / n;
+    *m2 += creal(conj(delta) * (value - *mean));
+}
+
+void binningJackknife(binning_t *binning, derived_function_t derived, int derived_count, double *error)
+{
+    int count = binning->observable_count, bins = binning->bin_count;
+    if (bins < 2) {
+        for (int d = 0; d < derived_count; d++)
+            error[d] = NAN;
+        return;
+    }
+
+    complex double *bin_sum = allocateOrDie(count, sizeof(complex double));
+    complex double *leave_one_out = allocateOrDie(count, sizeof(complex double));
+    complex double *value = allocateOrDie(derived_count, sizeof(complex double));
+    complex double *mean = allocateOrDie(derived_count, sizeof(complex double));
+    for (int b = 0; b < bins; b++)
+        for (int i = 0; i < count; i++)
+            bin_sum[i] += binning->bins[(size_t)b * count + i];
+
+    memset(error, 0, derived_count * sizeof(double));
+    for (int b = 0; b < bins; b++) {
+        for (int i = 0; i < count; i++)
+            leave_one_out[i] = (bin_sum[i] - binning->bins[(size_t)b * count + i]) / (bins - 1);
+        derived(leave_one_out, value);
+        for (int d = 0; d < derived_count; d++)
+            welfordUpdate(&mean[d], &error[d], value[d], b + 1);
+    }
+    // error has the sum of squared deviations here, which the jackknife scales by (n - 1) / n
+    for (int d = 0; d < derived_count; d++)
+        error[d] = sqrt(error[d] * (bins - 1) / bins);
+
+    free(bin_sum);
+    free(leave_one_out);
+    free(value);
+    free(mean);
+}
+
+void binningBootstrap(binning_t *binning, derived_function_t derived, int derived_count, int resamples, double *error)
+{
+    int count = binning->observable_count, bins = binning->bin_count;
+    if (bins < 2 || resamples < 2) {
+        for (int d = 0; d < derived_count; d++)
+            error[d] = NAN;
+        return;
+    }
+
+    complex double *resample = allocateOrDie(count, sizeof(complex double));
+    complex double *value = allocateOrDie(derived_count, sizeof(complex double));
+    complex double *mean = allocateOrDie(derived_count, sizeof(complex double));
+
+    memset(error, 0, derived_count * sizeof(double));
+    for (int r = 0; r < resamples; r++) {
+        memset(resample, 0, count * sizeof(complex double));
+        for (int b = 0; b < bins; b++) {
+            complex double *bin = binning->bins + (size_t)randomInt(0, bins) * count;
+            for (int i = 0; i < count; i++)
+                resample[i] += bin[i];
+        }
+        for (int i = 0; i < count; i++)
+            resample[i] /= bins;
+        derived(resample, value);
+        for (int d = 0; d < derived_count; d++)
+            welfordUpdate(&mean[d], &error[d], value[d], r + 1);
+    }
+    for (int d = 0; d < derived_count; d++)
+        error[d] = sqrt(error[d] / (resamples - 1));
+
+    free(resample);
+    free(value);
+    free(mean);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <complex.h>
+
+// streaming binning analysis with a fixed number of bins. once all of the bins are full,
+// neighbouring pairs get merged and the block size doubles, so memory stays at
+// O(max_bins) per observable no matter how many samples come through
+typedef struct {
+    int observable_count;
+    int max_bins;              // must be even
+    int bin_count;             // number of completed bins
+    unsigned long block_size;  // samples per completed bin
+    unsigned long in_block;    // samples in the incomplete bin
+    unsigned long samples;
+    complex double *bins;      // max_bins rows of observable_count bin means
+    complex double *partial;   // running sum of the incomplete bin
+    complex double *total;     // running sum of every sample
+} binning_t;
+
+// maps the mean of each observable to some derived quantities
+typedef void (*derived_function_t)(const complex double *mean, complex double *derived);
+
+void binningInit(binning_t *binning, int observable_count, int max_bins);
+
+void binningFree(binning_t *binning);
+
+// adds one sample of every observable
+void binningAdd(binning_t *binning, const complex double *sample);
+
+// mean of every sample so far, including the ones in the incomplete bin
+void binningMean(binning_t *binning, complex double *mean);
+
+// blocked jackknife over the completed bins, the derived quantities are
+// recomputed from every leave-one-bin-out mean. error is the magnitude of the deviation
+void binningJackknife(binning_t *binning, derived_function_t derived, int derived_count, double *error);
+
+// bootstrap over the completed bins with the given number of resamples
+void binningBootstrap(binning_t *binning, derived_function_t derived, int derived_count, int resamples, double *error);
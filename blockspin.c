@@ -0,0 +1,104 @@
+#include "blockspin.h"
+#include "popcount.h"
+#include <string.h>
+
+// the count bits of row starting at bit position start, count must be at most SPINS_PER_STATE_T
+static inline state_t getBits(const state_t *row, int start, int count)
+{
+    int offset = start % SPINS_PER_STATE_T;
+    const state_t *word = row + start / SPINS_PER_STATE_T;
+    state_t bits = word[0] >> offset;
+    if (offset + count > SPINS_PER_STATE_T)
+        bits |= word[1] << (SPINS_PER_STATE_T - offset);
+    state_t mask = count == SPINS_PER_STATE_T ? ~(state_t)0 : ((state_t)1 << count) - 1;
+    return bits & mask;
+}
+
+// packs the even bits of a into the low half, the inverse of interleaving with zeros
+static inline uint64_t compressEvenBits(uint64_t a)
+{
+    a &= 0x5555555555555555;
+    a = (a | (a >> 1))  & 0x3333333333333333;
+    a = (a | (a >> 2))  & 0x0f0f0f0f0f0f0f0f;
+    a = (a | (a >> 4))  & 0x00ff00ff00ff00ff;
+    a = (a | (a >> 8))  & 0x0000ffff0000ffff;
+    a = (a | (a >> 16)) & 0x00000000ffffffff;
+    return a;
+}
+
+// 2 x 2 blocks, done 32 blocks at a time. with a the top left spin and b, c, d the others,
+// the block is up when at least three are up, or exactly two are and one of them is a
+static void blockSpin2(const state_t *lattice, int space_len, int time_len, state_t *coarse)
+{
+    int row_states = ROW_STATE_COUNT(space_len);
+    int coarse_row_states = ROW_STATE_COUNT(space_len / 2);
+    for (int t = 0; t < time_len / 2; t++) {
+        const state_t *top = lattice + (size_t)2 * t * row_states;
+        const state_t *bottom = top + row_states;
+        for (int w = 0; w < row_states; w++) {
+            state_t a = top[w], b = top[w] >> 1, c = bottom[w], d = bottom[w] >> 1;
+            state_t majority = (a & (b | c | d)) | (b & c & d);
+            int bit = w * SPINS_PER_STATE_T / 2;
+            coarse[t * coarse_row_states + bit / SPINS_PER_STATE_T] |= compressEvenBits(majority) << (bit % SPINS_PER_STATE_T);
+        }
+    }
+}
+
+void blockSpin(const state_t *lattice, int space_len, int time_len, int block, state_t *coarse)
+{
+    int row_states = ROW_STATE_COUNT(space_len);
+    int coarse_space_len = space_len / block;
+    int coarse_row_states = ROW_STATE_COUNT(coarse_space_len);
+    memset(coarse, 0, (size_t)coarse_row_states * (time_len / block) * sizeof(state_t));
+
+    if (block == 2 && SPINS_PER_STATE_T == 64) {
+        blockSpin2(lattice, space_len, time_len, coarse);
+        // the padding past the end of each row might have picked up junk
+        if (coarse_space_len % SPINS_PER_STATE_T)
+            for (int t = 0; t < time_len / block; t++)
+                coarse[(t + 1) * coarse_row_states - 1] &= ((state_t)1 << (coarse_space_len % SPINS_PER_STATE_T)) - 1;
+        return;
+    }
+
+    for (int t = 0; t < time_len / block; t++) {
+        const state_t *top_row = lattice + (size_t)t * block * row_states;
+        for (int x = 0; x < coarse_space_len; x++) {
+            // count the up spins in the block a whole row segment at a time
+            int up = 0;
+            for (int dt = 0; dt < block; dt++)
+                for (int dx = 0; dx < block; dx += SPINS_PER_STATE_T) {
+                    int width = block - dx < SPINS_PER_STATE_T ? block - dx : SPINS_PER_STATE_T;
+                    up += popcount(getBits(top_row + dt * row_states, x * block + dx, width));
+                }
+
+            state_t majority;
+            if (2 * up == block * block)
+                majority = getBits(top_row, x * block, 1);
+            else
+                majority = 2 * up > block * block;
+            coarse[t * coarse_row_states + x / SPINS_PER_STATE_T] |= majority << (x % SPINS_PER_STATE_T);
+        }
+    }
+}
+
+size_t packRows(const state_t *lattice, int space_len, int time_len, state_t *packed)
+{
+    int row_states = ROW_STATE_COUNT(space_len);
+    size_t total_bits = (size_t)space_len * time_len;
+    size_t count = (total_bits + SPINS_PER_STATE_T - 1) / SPINS_PER_STATE_T;
+    memset(packed, 0, count * sizeof(state_t));
+
+    size_t bit = 0;
+    for (int t = 0; t < time_len; t++) {
+        for (int x = 0; x < space_len; x += SPINS_PER_STATE_T) {
+            int width = space_len - x < SPINS_PER_STATE_T ? space_len - x : SPINS_PER_STATE_T;
+            state_t bits = getBits(lattice + (size_t)t * row_states, x, width);
+            int offset = bit % SPINS_PER_STATE_T;
+            packed[bit / SPINS_PER_STATE_T] |= bits << offset;
+            if (offset + width > SPINS_PER_STATE_T)
+                packed[bit / SPINS_PER_STATE_T + 1] |= bits >> (SPINS_PER_STATE_T - offset);
+            bit += width;
+        }
+    }
+    return count;
+}
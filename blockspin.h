@@ -0,0 +1,15 @@
+#pragma once
+#include <stddef.h>
+#include "ising.h"
+
+// number of state_t's in each row of a lattice that is space_len spins wide
+#define ROW_STATE_COUNT(space_len) (((space_len) + SPINS_PER_STATE_T - 1) / SPINS_PER_STATE_T)
+
+// majority rule block spin transformation of a space_len x time_len lattice into a
+// (space_len / block) x (time_len / block) one, both packed the same way as the full lattice.
+// a tied block takes the spin of its top left corner. both lengths must be multiples of block
+void blockSpin(const state_t *lattice, int space_len, int time_len, int block, state_t *coarse);
+
+// packs the rows of a lattice back to back with no padding between them, which is the
+// layout of the coarse grained ISI files. returns the number of state_t's written to packed
+size_t packRows(const state_t *lattice, int space_len, int time_len, state_t *packed);
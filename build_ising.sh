@@ -2,7 +2,11 @@
 cd npy_array
 make
 cd ..
-gcc -c ising.c record.c -fopenmp -g -O3
-gcc ising.o record.o hot_v_cold.c -L./npy_array -l:libnpy_array.a -lm -Wall -o hot_v_cold
-gcc ising.o record.o generate_states.c -O3 -lm -fopenmp -Wall -o generate_states
-gcc ising.o record.o correlation.c -g -O3 -L./npy_array -l:libnpy_array.a -lm -o correlation
+gcc -c ising.c rng.c record.c histogram.c binning.c worldline.c blockspin.c nfold.c correlator.c demon.c engine.c -fopenmp -g -O3
+gcc ising.o rng.o record.o nfold.o hot_v_cold.c -L./npy_array -l:libnpy_array.a -lm -pthread -fopenmp -Wall -o hot_v_cold
+gcc ising.o rng.o record.o histogram.o blockspin.o nfold.o demon.o engine.o generate_states.c -O3 -L./npy_array -l:libnpy_array.a -lm -pthread -fopenmp -Wall -o generate_states
+gcc ising.o rng.o record.o binning.o correlator.o correlation.c -g -O3 -L./npy_array -l:libnpy_array.a -lm -pthread -o correlation
+gcc ising.o rng.o record.o histogram.o reweight.c -g -O3 -L./npy_array -l:libnpy_array.a -lm -pthread -fopenmp -Wall -o reweight
+gcc ising.o rng.o record.o wang_landau.c -O3 -L./npy_array -l:libnpy_array.a -lm -pthread -fopenmp -Wall -o wang_landau
+gcc ising.o rng.o record.o worldline.o continuous_time.c -O3 -lm -pthread -fopenmp -Wall -o continuous_time
+gcc ising.o rng.o record.o binning.o correlator.o nfold.o demon.o engine.o pipeline.c -O3 -L./npy_array -l:libnpy_array.a -lm -pthread -fopenmp -Wall -o pipeline
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include "ising.h"
+#include "rng.h"
+#include "record.h"
+#include "worldline.h"
+#include "parse_args.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 8) {
+        fprintf(stderr, "usage: %s <j> <gamma> <h*mu> <beta> <sweeps> <count> <filename>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    double j     = parseDouble(argv[1], "j");
+    double gamma = parseDouble(argv[2], "gamma");
+    double h_mu  = parseDouble(argv[3], "h_mu");
+    double beta  = parseDouble(argv[4], "beta");
+
+    unsigned long sweeps = parseUnsignedLong(argv[5], "sweeps");
+    unsigned long count  = parseUnsignedLong(argv[6], "count");
+
+    char *filename = argv[7];
+
+    // the couplings of the discretized lattice the saved states correspond to
+    printf("K_space: %f, K_time: %f\n", beta * j / TIME_LEN, -log(tanh(beta * gamma / TIME_LEN)) / 2);
+
+    FILE *data_file = fopen(filename, "w");
+    if (!data_file) {
+        perror("error opening file");
+        exit(EXIT_FAILURE);
+    }
+
+    if (writeHeader(data_file, j, beta)) {
+        fprintf(stderr, "error writing to file\n");
+        exit(EXIT_FAILURE);
+    }
+
+#pragma omp threadprivate(xorshift_state)
+#pragma omp parallel
+    {
+        for (int i = 0; i < omp_get_thread_num(); i++)
+            jump();
+    }
+
+    double magnetization_sum = 0, kink_sum = 0;
+#pragma omp parallel for reduction(+:magnetization_sum, kink_sum)
+    for (unsigned long i = 0; i < count; i++) {
+        rng_t rng;
+        rngSeed(&rng);
+        worldlines_t worldlines;
+        worldlinesInit(&worldlines, beta);
+        for (unsigned long s = 0; s < sweeps; s++)
+            clusterUpdate(&worldlines, &rng, j, gamma, h_mu);
+
+        magnetization_sum += fabs(worldlinesMagnetization(&worldlines)) / SPACE_LEN;
+        kink_sum += (double)worldlinesKinkCount(&worldlines) / SPACE_LEN;
+
+        state_t lattice[TIME_LEN * SPACE_STATE_COUNT];
+        worldlinesToLattice(&worldlines, lattice);
+        worldlinesFree(&worldlines);
+        // same as generate_states, writeState() is a single fwrite
+        if (writeState(data_file, lattice)) {
+            fprintf(stderr, "error writing to file\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(data_file);
+
+    // gamma <sigma^x> per site is the kink density over beta
+    printf("|m|: %f, kinks per site: %f, gamma <sigma^x>: %f\n",
+            magnetization_sum / count, kink_sum / count, kink_sum / count / beta);
+
+    return EXIT_SUCCESS;
+}
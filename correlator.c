@@ -0,0 +1,107 @@
+#include "correlator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "record.h"
+
+// filled in once before anything reads them, which makes fourierTransformSpace() thread-safe
+static complex double dft_precomp_table[SPACE_LEN][2 * SPACE_LEN];
+
+static void precomputeTables()
+{
+    for (int k = 0; k < SPACE_LEN; k++) {
+        double p_n = 2 * M_PI * (double)k / SPACE_LEN;
+        for (int x = 0; x < 2 * SPACE_LEN; x += 2) {
+            complex double vec = cexp(CMPLX(0, p_n * (x / 2)));
+            dft_precomp_table[k][x] = -vec;
+            dft_precomp_table[k][x + 1] = vec;
+        }
+    }
+}
+
+void fourierTransformSpace(const state_t *lattice, complex double *output, unsigned k)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    if (k >= SPACE_LEN)
+        return;
+    pthread_once(&once, precomputeTables);
+    const complex double *dft_precomp = &dft_precomp_table[k][0];
+
+    for (int t = 0; t < TIME_LEN; t++) {
+        complex double sum = CMPLX(0, 0);
+        for (int x = 0; x < SPACE_STATE_COUNT; x++) {
+            state_t spin_set = lattice[t * SPACE_STATE_COUNT + x];
+            
+            for (int bit = 0; bit < SPINS_PER_STATE_T; bit++, spin_set >>= 1)
+                sum += dft_precomp[2 * (x * SPINS_PER_STATE_T + bit) + (spin_set & 1)];
+        }
+        output[t] = sum;
+    }
+}
+
+void correlatorSample(const state_t *lattice, complex double *sample)
+{
+    for (int n = 0; n < SPACE_LEN / 2; n++) {
+        complex double output[TIME_LEN];
+        fourierTransformSpace(lattice, output, n);
+        for (int i = 0; i < TIME_LEN; i++)
+            sample[n * TIME_LEN + i] = conj(output[0]) * output[i];
+    }
+}
+
+void normalizedCorrelations(const complex double *mean, complex double *derived)
+{
+    for (int n = 0; n < SPACE_LEN / 2; n++) {
+        double norm = cabs(mean[n * TIME_LEN]);
+        for (int i = 0; i < TIME_LEN; i++)
+            derived[n * TIME_LEN + i] = mean[n * TIME_LEN + i] / norm;
+    }
+}
+
+void effectiveMasses(const complex double *mean, complex double *derived)
+{
+    for (int n = 0; n < SPACE_LEN / 2; n++) {
+        for (int i = 0; i < TIME_LEN - 1; i++)
+            derived[n * TIME_LEN + i] = log(creal(mean[n * TIME_LEN + i]) / creal(mean[n * TIME_LEN + i + 1]));
+        derived[n * TIME_LEN + TIME_LEN - 1] = NAN;
+    }
+}
+
+int correlatorSave(const char *filename, binning_t *binning, int resamples)
+{
+    npy_array_t correlation_out = createNpyArrayNd('c', sizeof(complex double), 2, SPACE_LEN / 2, TIME_LEN);
+    npy_array_t error_out = createNpyArrayNd('f', sizeof(double), 2, SPACE_LEN / 2, TIME_LEN);
+    npy_array_t bootstrap_error_out = createNpyArrayNd('f', sizeof(double), 2, SPACE_LEN / 2, TIME_LEN);
+    npy_array_t mass_out = createNpyArrayNd('f', sizeof(double), 2, SPACE_LEN / 2, TIME_LEN);
+    npy_array_t mass_error_out = createNpyArrayNd('f', sizeof(double), 2, SPACE_LEN / 2, TIME_LEN);
+    npy_array_t mass_bootstrap_error_out = createNpyArrayNd('f', sizeof(double), 2, SPACE_LEN / 2, TIME_LEN);
+
+    complex double mean[OBSERVABLE_COUNT], masses[OBSERVABLE_COUNT];
+    binningMean(binning, mean);
+    normalizedCorrelations(mean, (complex double *)correlation_out.data);
+    effectiveMasses(mean, masses);
+    for (int i = 0; i < OBSERVABLE_COUNT; i++)
+        ((double *)mass_out.data)[i] = creal(masses[i]);
+
+    binningJackknife(binning, normalizedCorrelations, OBSERVABLE_COUNT, (double *)error_out.data);
+    binningJackknife(binning, effectiveMasses, OBSERVABLE_COUNT, (double *)mass_error_out.data);
+    binningBootstrap(binning, normalizedCorrelations, OBSERVABLE_COUNT, resamples, (double *)bootstrap_error_out.data);
+    binningBootstrap(binning, effectiveMasses, OBSERVABLE_COUNT, resamples, (double *)mass_bootstrap_error_out.data);
+
+    npy_array_t *arrays[] = {
+        &mass_bootstrap_error_out, &mass_error_out, &mass_out, &bootstrap_error_out, &error_out, &correlation_out,
+    };
+    const char *names[] = {
+        "effective_mass_bootstrap_error", "effective_mass_error", "effective_mass", "bootstrap_error", "error", "correlations",
+    };
+    int array_count = sizeof(arrays) / sizeof(*arrays);
+    npy_array_list_t *array_head = NULL;
+    for (int i = 0; i < array_count; i++) {
+        array_head = npy_array_list_prepend(array_head, arrays[i], names[i]);
+        if (!array_head)
+            return -1;
+    }
+    
+    return npy_array_list_save(filename, array_head) == array_count ? 0 : -1;
+}
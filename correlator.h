@@ -0,0 +1,26 @@
+#pragma once
+#include <complex.h>
+#include "ising.h"
+#include "binning.h"
+
+// C_n(t) for every spatial momentum n < SPACE_LEN / 2 and every time slice
+#define OBSERVABLE_COUNT (SPACE_LEN / 2 * TIME_LEN)
+#define DEFAULT_BINS 64
+#define DEFAULT_RESAMPLES 200
+
+// apply fourier transform across the space dimension
+// output should have TIME_LEN complex doubles allocated
+void fourierTransformSpace(const state_t *lattice, complex double *output, unsigned k);
+
+// one lattice's contribution to every correlator, sample should have OBSERVABLE_COUNT allocated
+void correlatorSample(const state_t *lattice, complex double *sample);
+
+// the correlators normalized by |C_n(0)|
+void normalizedCorrelations(const complex double *mean, complex double *derived);
+
+// effective mass log(C_n(t) / C_n(t + 1)), the last time slice has no partner so it is NAN
+void effectiveMasses(const complex double *mean, complex double *derived);
+
+// saves the correlators, effective masses and their jackknife and bootstrap errors to an npz file
+// returns 0 on success
+int correlatorSave(const char *filename, binning_t *binning, int resamples);
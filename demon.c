@@ -0,0 +1,158 @@
+#include "demon.h"
+#include <math.h>
+#include <string.h>
+#include "popcount.h"
+
+_Static_assert(SPACE_LEN % SPINS_PER_STATE_T == 0, "the demon engine needs whole state_t rows");
+_Static_assert(TIME_LEN % 2 == 0, "the demon engine needs a checkerboard that wraps around");
+_Static_assert(DEMON_BITS >= 3, "the demons must be able to hold a change of 4 broken bonds");
+
+// every bit is set with probability / 2^DEMON_PRECISION. going from the lowest bit of the
+// probability up, each random word averages the chance so far with either 0 or 1
+static inline state_t biasedBits(rng_t *rng, uint32_t probability)
+{
+    if (!probability)
+        return 0;
+    state_t bits = 0;
+    for (int k = __builtin_ctz(probability); k < DEMON_PRECISION; k++)
+        bits = (probability >> k) & 1 ? bits | rngNext(rng) : bits & rngNext(rng);
+    return bits;
+}
+
+// bits of colour are the sites with x + t even for colour 0 and odd for colour 1
+static inline state_t colourMask(int t, int colour)
+{
+    return (t + colour) % 2 ? (state_t)0xaaaaaaaaaaaaaaaa : (state_t)0x5555555555555555;
+}
+
+// flips every site of colour in word i of row t whose demon can take, or give up, the energy
+static inline void updateWord(demon_t *demon, int t, int i, state_t colour)
+{
+    state_t *row = demon->lattice + t * SPACE_STATE_COUNT;
+    state_t spins = row[i];
+    state_t up    = demon->lattice[(t + TIME_LEN - 1) % TIME_LEN * SPACE_STATE_COUNT + i];
+    state_t down  = demon->lattice[(t + 1) % TIME_LEN * SPACE_STATE_COUNT + i];
+    state_t left  = spins << 1 | row[(i + SPACE_STATE_COUNT - 1) % SPACE_STATE_COUNT] >> (SPINS_PER_STATE_T - 1);
+    state_t right = spins >> 1 | row[(i + 1) % SPACE_STATE_COUNT] << (SPINS_PER_STATE_T - 1);
+
+    // count the broken bonds b with full adders, a flip changes the energy by 4|j| (2 - b)
+    state_t a = spins ^ up ^ demon->broken, b = spins ^ down ^ demon->broken;
+    state_t c = spins ^ left ^ demon->broken, d = spins ^ right ^ demon->broken;
+    state_t low = a ^ b, high = c ^ d;
+    state_t carry_low = a & b, carry_high = c & d, carry_mid = low & high;
+    state_t broken[3] = { low ^ high, carry_low ^ carry_high ^ carry_mid, carry_low & carry_high };
+
+    // the demon ends up with D + b - 2, which has to stay in [0, DEMON_LEVELS)
+    state_t sum[DEMON_BITS + 1], carry = 0;
+    for (int bit = 0; bit < DEMON_BITS; bit++) {
+        state_t x = demon->demons[bit][t * SPACE_STATE_COUNT + i], y = bit < 3 ? broken[bit] : 0;
+        sum[bit] = x ^ y ^ carry;
+        carry = (x & y) | (carry & (x ^ y));
+    }
+    sum[DEMON_BITS] = carry;
+    state_t borrow = ~sum[1];
+    sum[1] = ~sum[1];
+    for (int bit = 2; bit <= DEMON_BITS; bit++) {
+        state_t x = sum[bit];
+        sum[bit] = x ^ borrow;
+        borrow &= ~x;
+    }
+
+    state_t accept = colour & ~borrow & ~sum[DEMON_BITS];
+    row[i] = spins ^ accept;
+    for (int bit = 0; bit < DEMON_BITS; bit++) {
+        state_t *demon_bits = &demon->demons[bit][t * SPACE_STATE_COUNT + i];
+        *demon_bits = (sum[bit] & accept) | (*demon_bits & ~accept);
+    }
+}
+
+void demonInit(demon_t *demon, state_t *lattice, double j, double beta)
+{
+    demon->lattice = lattice;
+    demon->broken = j < 0 ? ~(state_t)0 : 0;
+    memset(demon->counts, 0, sizeof(demon->counts));
+    demon->sweeps = 0;
+    rngSeed(&demon->rng);
+
+    // P(D) is proportional to q^D on [0, DEMON_LEVELS), which factors into independent bits
+    // each set with probability q^(2^bit) / (1 + q^(2^bit))
+    double q = exp(-4 * fabs(j) * beta);
+    for (int bit = 0; bit < DEMON_BITS; bit++) {
+        double weight = pow(q, 1 << bit);
+        demon->bit_probabilities[bit] = lround(weight / (1 + weight) * (1 << DEMON_PRECISION));
+    }
+
+    for (int bit = 0; bit < DEMON_BITS; bit++)
+        for (int i = 0; i < TIME_LEN * SPACE_STATE_COUNT; i++)
+            demon->demons[bit][i] = biasedBits(&demon->rng, demon->bit_probabilities[bit]);
+}
+
+void demonSweep(demon_t *demon)
+{
+    // sites of one colour only neighbour the other, so a whole colour can be updated at once
+    for (int colour = 0; colour < 2; colour++)
+        for (int t = 0; t < TIME_LEN; t++) {
+            state_t mask = colourMask(t, colour);
+            for (int i = 0; i < SPACE_STATE_COUNT; i++)
+                updateWord(demon, t, i, mask);
+        }
+}
+
+// adds the demon energies to the histogram
+static void demonCount(demon_t *demon)
+{
+    for (int i = 0; i < TIME_LEN * SPACE_STATE_COUNT; i++)
+        for (int level = 0; level < DEMON_LEVELS; level++) {
+            state_t match = ~(state_t)0;
+            for (int bit = 0; bit < DEMON_BITS; bit++)
+                match &= (level >> bit) & 1 ? demon->demons[bit][i] : ~demon->demons[bit][i];
+            demon->counts[level] += popcount(match);
+        }
+}
+
+void demonRefresh(demon_t *demon)
+{
+    for (int bit = 0; bit < DEMON_BITS; bit++)
+        for (int i = 0; i < TIME_LEN * SPACE_STATE_COUNT; i++)
+            demon->demons[bit][i] = biasedBits(&demon->rng, demon->bit_probabilities[bit]);
+}
+
+void demonAdvance(demon_t *demon, unsigned long sweeps)
+{
+    for (unsigned long s = 0; s < sweeps; s++) {
+        // the refresh waits for the next sweep, so the demons of the last stretch can still be read
+        if (demon->sweeps && demon->sweeps % DEMON_REFRESH_SWEEPS == 0)
+            demonRefresh(demon);
+        demonSweep(demon);
+        if (++demon->sweeps % DEMON_REFRESH_SWEEPS == 0)
+            demonCount(demon);
+    }
+}
+
+double demonBeta(const unsigned long *counts, double j)
+{
+    double total = 0, mean = 0;
+    for (int level = 0; level < DEMON_LEVELS; level++) {
+        total += counts[level];
+        mean += (double)level * counts[level];
+    }
+    if (total == 0)
+        return NAN;
+    mean /= total;
+
+    // the mean of q^D falls as x = -log(q) rises, so bisect for the x that matches the data
+    double lower = -32, upper = 32;
+    for (int step = 0; step < 100; step++) {
+        double x = (lower + upper) / 2, weight_sum = 0, level_sum = 0;
+        for (int level = 0; level < DEMON_LEVELS; level++) {
+            double weight = exp(-x * level);
+            weight_sum += weight;
+            level_sum += level * weight;
+        }
+        if (level_sum / weight_sum > mean)
+            lower = x;
+        else
+            upper = x;
+    }
+    return (lower + upper) / 2 / (4 * fabs(j));
+}
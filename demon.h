@@ -0,0 +1,41 @@
+#pragma once
+#include "ising.h"
+#include "rng.h"
+
+// bits of demon energy per site, in units of 4|j| which is the smallest energy change of a flip
+#define DEMON_BITS 4
+#define DEMON_LEVELS (1 << DEMON_BITS)
+// the demons go back to the canonical distribution after this many microcanonical sweeps
+#define DEMON_REFRESH_SWEEPS 4
+// bits of precision in the probability of each demon bit when they are redrawn
+#define DEMON_PRECISION 24
+
+// Creutz demon microcanonical engine with one demon per site. the demon energies are stored
+// bit sliced, one plane per bit laid out like the lattice, so a sweep updates a whole state_t
+// of sites with bitwise arithmetic and no random numbers. only h_mu = 0 is supported
+typedef struct {
+    state_t *lattice;
+    state_t demons[DEMON_BITS][TIME_LEN * SPACE_STATE_COUNT];
+    state_t broken;                           // xored with s_i ^ s_j to give 1 on the high energy bonds
+    uint32_t bit_probabilities[DEMON_BITS];   // canonical chance of each demon bit, out of 2^DEMON_PRECISION
+    unsigned long counts[DEMON_LEVELS];       // demon energies seen at the end of each microcanonical stretch
+    unsigned long sweeps;                     // sweeps done by demonAdvance(), over every call
+    rng_t rng;
+} demon_t;
+
+// draws the demons from the canonical distribution at beta, the lattice is updated in place afterwards
+void demonInit(demon_t *demon, state_t *lattice, double j, double beta);
+
+// one deterministic checkerboard sweep, the total of the lattice and demon energy is conserved
+void demonSweep(demon_t *demon);
+
+// redraws every demon from the canonical distribution
+void demonRefresh(demon_t *demon);
+
+// sweeps, counting the demons at the end of every DEMON_REFRESH_SWEEPS sweeps and refreshing
+// them before the next one. the schedule carries over between calls, however they are split up
+void demonAdvance(demon_t *demon, unsigned long sweeps);
+
+// maximum likelihood beta of a histogram of demon energies, which is canonically distributed
+// at the temperature of the lattice the demons are in contact with
+double demonBeta(const unsigned long *counts, double j);
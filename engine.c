@@ -0,0 +1,26 @@
+#include "engine.h"
+#include "nfold.h"
+#include "demon.h"
+
+void advanceLattice(int algorithm, state_t *lattice, double j, double h_mu, double beta, unsigned long iterations,
+        unsigned long *demon_counts)
+{
+    if (algorithm == ALGORITHM_NFOLD) {
+        nfold_t *nfold = nfoldCreate(lattice, j, h_mu, beta);
+        nfoldAdvance(nfold, hamiltonian(lattice, j, h_mu), iterations);
+        nfoldDestroy(nfold);
+    }
+    else if (algorithm == ALGORITHM_DEMON) {
+        // a sweep updates every site once, so round the iterations up to whole sweeps
+        demon_t demon;
+        demonInit(&demon, lattice, j, beta);
+        demonAdvance(&demon, (iterations + SPACE_LEN * TIME_LEN - 1) / (SPACE_LEN * TIME_LEN));
+        if (demon_counts) {
+#pragma omp critical(demon)
+            for (int level = 0; level < DEMON_LEVELS; level++)
+                demon_counts[level] += demon.counts[level];
+        }
+    }
+    else
+        metropolis(lattice, hamiltonian(lattice, j, h_mu), j, h_mu, beta, iterations);
+}
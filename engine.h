@@ -0,0 +1,7 @@
+#pragma once
+#include "ising.h"
+
+// runs the given number of metropolis iterations worth of updates on lattice with the chosen algorithm.
+// for the demon engine, demon_counts gets its DEMON_LEVELS demon energy counts added unless it is NULL
+void advanceLattice(int algorithm, state_t *lattice, double j, double h_mu, double beta, unsigned long iterations,
+        unsigned long *demon_counts);
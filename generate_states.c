@@ -1,43 +1,57 @@
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <omp.h>
 #include "ising.h"
 #include "record.h"
+#include "histogram.h"
+#include "blockspin.h"
+#include "engine.h"
+#include "demon.h"
 #include "parse_args.h"
 
-// yoinked from David Blackman and Sebastiano Vigna's excellent 'PRNG shootout' page (CC0)
-// equivalent to calling xorshift256() 2^128 times
-void jump()
+#define MAX_BLOCK_LEVELS 8
+
+void usage(char *program_name)
 {
-    static const uint64_t JUMP[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
-
-    uint64_t s0 = 0;
-    uint64_t s1 = 0;
-    uint64_t s2 = 0;
-    uint64_t s3 = 0;
-    for(int i = 0; i < sizeof(JUMP) / sizeof(*JUMP); i++)
-        for(int b = 0; b < 64; b++) {
-            if (JUMP[i] & UINT64_C(1) << b) {
-                s0 ^= xorshift_state[0];
-                s1 ^= xorshift_state[1];
-                s2 ^= xorshift_state[2];
-                s3 ^= xorshift_state[3];
-            }
-            xorshift256();    
-        }
-        
-    xorshift_state[0] = s0;
-    xorshift_state[1] = s1;
-    xorshift_state[2] = s2;
-    xorshift_state[3] = s3;
+    fprintf(stderr, "usage: %s [-a metropolis|nfold|demon] [-H histogram.npy] [-b block [-l levels] [-n]] <j> <h*mu> <beta> <iterations> <count> <filename>\n", program_name);
+    exit(EXIT_FAILURE);
 }
 
 int main(int argc, char **argv)
 {
-    if (argc != 7) {
-        fprintf(stderr, "usage: %s <j> <h*mu> <beta> <iterations> <count> <filename>\n", argv[0]);
-        exit(EXIT_FAILURE);
+    char *program_name = argv[0];
+    char *histogram_filename = NULL;
+    int block = 0, block_levels = 1, write_full = 1;
+    int algorithm = ALGORITHM_METROPOLIS;
+
+    int option;
+    while ((option = getopt(argc, argv, "a:H:b:l:n")) != -1) {
+        switch (option) {
+        case 'a':
+            algorithm = parseAlgorithm(optarg, "algorithm");
+            break;
+        case 'H':
+            histogram_filename = optarg;
+            break;
+        case 'b':
+            block = parseUnsignedLong(optarg, "block");
+            break;
+        case 'l':
+            block_levels = parseUnsignedLong(optarg, "levels");
+            break;
+        case 'n':
+            write_full = 0;
+            break;
+        default:
+            usage(program_name);
+        }
     }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (argc != 7)
+        usage(program_name);
 
     double j    = parseDouble(argv[1], "j");
     double h_mu = parseDouble(argv[2], "h_mu");
@@ -48,17 +62,62 @@ int main(int argc, char **argv)
 
     char *filename = argv[6];
 
-    FILE *data_file = fopen(filename, "w");
-    if (!data_file) {
-        perror("error opening file");
+    if (!block && (!write_full || block_levels != 1))
+        usage(program_name);
+
+    if (algorithm == ALGORITHM_DEMON && (h_mu != 0 || j == 0)) {
+        fprintf(stderr, "the demon engine needs h_mu = 0 and j != 0\n");
         exit(EXIT_FAILURE);
     }
 
-    if (writeHeader(data_file, j, beta)) {
-        fprintf(stderr, "error writing to file\n");
-        exit(EXIT_FAILURE);
+    FILE *data_file = NULL;
+    if (write_full) {
+        data_file = fopen(filename, "w");
+        if (!data_file) {
+            perror("error opening file");
+            exit(EXIT_FAILURE);
+        }
+
+        if (writeHeader(data_file, j, beta)) {
+            fprintf(stderr, "error writing to file\n");
+            exit(EXIT_FAILURE);
+        }
     }
 
+    // every block spin level goes to its own file, <filename>.b<total block factor>
+    FILE *block_files[MAX_BLOCK_LEVELS] = { NULL };
+    if (block) {
+        if (block < 2 || block_levels < 1 || block_levels > MAX_BLOCK_LEVELS) {
+            fprintf(stderr, "the block factor must be at least 2 with 1 to %d levels\n", MAX_BLOCK_LEVELS);
+            exit(EXIT_FAILURE);
+        }
+        int factor = 1;
+        for (int level = 0; level < block_levels; level++) {
+            factor *= block;
+            if (SPACE_LEN % factor || TIME_LEN % factor) {
+                fprintf(stderr, "block factor %d does not divide the %dx%d lattice\n", factor, SPACE_LEN, TIME_LEN);
+                exit(EXIT_FAILURE);
+            }
+            char block_filename[strlen(filename) + 16];
+            sprintf(block_filename, "%s.b%d", filename, factor);
+            block_files[level] = fopen(block_filename, "w");
+            if (!block_files[level]) {
+                perror("error opening file");
+                exit(EXIT_FAILURE);
+            }
+            if (writeHeaderBlocked(block_files[level], j, beta, factor)) {
+                fprintf(stderr, "error writing to file\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    // joint (bondSum(), magnetization()) histogram of the final states, for reweighting
+    histogram_t histogram;
+    histogramInit(&histogram);
+    // demon energies of every lattice, their distribution gives the temperature actually reached
+    unsigned long demon_counts[DEMON_LEVELS] = { 0 };
+
 #pragma omp threadprivate(xorshift_state)
 #pragma omp parallel
     {
@@ -70,13 +129,41 @@ int main(int argc, char **argv)
     for (unsigned long i = 0; i < count; i++) {
         state_t lattice[TIME_LEN * SPINS_PER_STATE_T] = { 0 };
         initLattice(lattice);
-        metropolis(lattice, hamiltonian(lattice, j, h_mu), j, h_mu, beta, iterations);
-        // since writeState() only makes one call to fwrite, it should be thread-safe
-        // this is actually only true on POSIX systems, linux and windows, but that is
-        // basically all of the targets for this program
-        if (writeState(data_file, lattice)) {
-            fprintf(stderr, "error writing to file\n");
-            exit(EXIT_FAILURE);
+        advanceLattice(algorithm, lattice, j, h_mu, beta, iterations, demon_counts);
+        if (histogram_filename) {
+            int bond_sum = bondSum(lattice);
+            int total_spin = magnetization(lattice);
+#pragma omp critical(histogram)
+            histogramAdd(&histogram, bond_sum, total_spin, 1);
+        }
+        // each level coarse grains the one before it
+        state_t coarse[2][TIME_LEN * SPACE_STATE_COUNT];
+        state_t packed[MAX_BLOCK_LEVELS][TIME_LEN * SPACE_STATE_COUNT];
+        size_t packed_counts[MAX_BLOCK_LEVELS];
+        state_t *finer = lattice;
+        int space_len = SPACE_LEN, time_len = TIME_LEN;
+        for (int level = 0; block && level < block_levels; level++) {
+            state_t *coarser = coarse[level % 2];
+            blockSpin(finer, space_len, time_len, block, coarser);
+            space_len /= block;
+            time_len /= block;
+            packed_counts[level] = packRows(coarser, space_len, time_len, packed[level]);
+            finer = coarser;
+        }
+
+        // every file gets this lattice's record at the same position, so record k of
+        // <filename>.bN is always the coarse grained record k of <filename>
+#pragma omp critical(write)
+        {
+            if (write_full && writeState(data_file, lattice)) {
+                fprintf(stderr, "error writing to file\n");
+                exit(EXIT_FAILURE);
+            }
+            for (int level = 0; block && level < block_levels; level++)
+                if (writeStateSized(block_files[level], packed[level], packed_counts[level])) {
+                    fprintf(stderr, "error writing to file\n");
+                    exit(EXIT_FAILURE);
+                }
         }
         //puts("");
         //printLattice(lattice);
@@ -85,5 +172,21 @@ int main(int argc, char **argv)
         //printLattice(lattice);
 
     }
-    fclose(data_file);
+    if (data_file)
+        fclose(data_file);
+    for (int level = 0; level < MAX_BLOCK_LEVELS; level++)
+        if (block_files[level])
+            fclose(block_files[level]);
+
+    if (algorithm == ALGORITHM_DEMON)
+        printf("demon beta: %f, target beta: %f\n", demonBeta(demon_counts, j), beta);
+
+    if (histogram_filename) {
+        histogramCollapse(&histogram);
+        if (histogramSave(histogram_filename, &histogram)) {
+            fprintf(stderr, "error saving histogram\n");
+            exit(EXIT_FAILURE);
+        }
+        histogramFree(&histogram);
+    }
 }
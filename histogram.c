@@ -0,0 +1,99 @@
+#include "histogram.h"
+#include "record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void histogramInit(histogram_t *histogram)
+{
+    *histogram = (histogram_t) { .bins = NULL, .length = 0, .capacity = 0 };
+}
+
+void histogramFree(histogram_t *histogram)
+{
+    free(histogram->bins);
+    histogramInit(histogram);
+}
+
+void histogramAdd(histogram_t *histogram, int64_t bond_sum, int64_t magnetization, int64_t count)
+{
+    if (histogram->length == histogram->capacity) {
+        size_t capacity = histogram->capacity ? 2 * histogram->capacity : 64;
+        histogram_bin_t *bins = realloc(histogram->bins, capacity * sizeof(histogram_bin_t));
+        if (!bins) {
+            fprintf(stderr, "Error allocating histogram, abort!\n");
+            exit(EXIT_FAILURE);
+        }
+        histogram->bins = bins;
+        histogram->capacity = capacity;
+    }
+    histogram->bins[histogram->length++] = (histogram_bin_t) {
+        .bond_sum = bond_sum, .magnetization = magnetization, .count = count
+    };
+}
+
+static int compareBins(const void *a, const void *b)
+{
+    const histogram_bin_t *bin_a = a, *bin_b = b;
+    if (bin_a->bond_sum != bin_b->bond_sum)
+        return (bin_a->bond_sum > bin_b->bond_sum) - (bin_a->bond_sum < bin_b->bond_sum);
+    return (bin_a->magnetization > bin_b->magnetization) - (bin_a->magnetization < bin_b->magnetization);
+}
+
+void histogramCollapse(histogram_t *histogram)
+{
+    if (histogram->length == 0)
+        return;
+
+    qsort(histogram->bins, histogram->length, sizeof(histogram_bin_t), compareBins);
+    size_t merged = 0;
+    for (size_t i = 1; i < histogram->length; i++) {
+        if (compareBins(&histogram->bins[merged], &histogram->bins[i]) == 0)
+            histogram->bins[merged].count += histogram->bins[i].count;
+        else
+            histogram->bins[++merged] = histogram->bins[i];
+    }
+    histogram->length = merged + 1;
+}
+
+int64_t histogramSamples(histogram_t *histogram)
+{
+    int64_t samples = 0;
+    for (size_t i = 0; i < histogram->length; i++)
+        samples += histogram->bins[i].count;
+    return samples;
+}
+
+int histogramSave(const char *filename, histogram_t *histogram)
+{
+    if (histogram->length == 0)
+        return -1;
+
+    npy_array_t array = createNpyArrayNd('i', sizeof(int64_t), 2, (int)histogram->length, 3);
+    memcpy(array.data, histogram->bins, histogram->length * sizeof(histogram_bin_t));
+    npy_array_save(filename, &array);
+    free(array.data);
+    return 0;
+}
+
+int histogramLoad(const char *filename, histogram_t *histogram)
+{
+    npy_array_t *array = npy_array_load(filename);
+    if (!array)
+        return -1;
+
+    if (array->typechar != 'i' || array->elem_size != sizeof(int64_t) || array->ndim != 2 || array->shape[1] != 3) {
+        fprintf(stderr, "%s is not a histogram\n", filename);
+        npy_array_free(array);
+        return -1;
+    }
+
+    histogramInit(histogram);
+    int64_t *rows = (int64_t *)array->data;
+    for (size_t i = 0; i < array->shape[0]; i++)
+        histogramAdd(histogram, rows[3 * i], rows[3 * i + 1], rows[3 * i + 2]);
+    npy_array_free(array);
+
+    histogramCollapse(histogram);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "ising.h"
+
+// one bin of a joint energy / magnetization histogram. since H = -j * bondSum() - h_mu * magnetization(),
+// the pair (bond_sum, magnetization) pins down the energy exactly for any j and h_mu
+typedef struct {
+    int64_t bond_sum;
+    int64_t magnetization;
+    int64_t count;
+} histogram_bin_t;
+
+// sparse histogram, a dense one would need (2N + 1) * (N + 1) bins
+typedef struct {
+    histogram_bin_t *bins;
+    size_t length;
+    size_t capacity;
+} histogram_t;
+
+void histogramInit(histogram_t *histogram);
+
+void histogramFree(histogram_t *histogram);
+
+// appends a bin, duplicates are only merged by histogramCollapse()
+void histogramAdd(histogram_t *histogram, int64_t bond_sum, int64_t magnetization, int64_t count);
+
+// sorts the bins and merges the ones with the same (bond_sum, magnetization)
+void histogramCollapse(histogram_t *histogram);
+
+// the total number of samples in the histogram
+int64_t histogramSamples(histogram_t *histogram);
+
+// saves the histogram as a (length, 3) int64 .npy array of
+// bond_sum, magnetization, count rows, returns 0 on success
+int histogramSave(const char *filename, histogram_t *histogram);
+
+// loads a histogram written by histogramSave(), returns 0 on success
+int histogramLoad(const char *filename, histogram_t *histogram);
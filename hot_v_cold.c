@@ -1,17 +1,167 @@
 #include "ising.h"
-#include "npy_array/npy_array.h"
 #include "record.h"
+#include "nfold.h"
 #include "parse_args.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <omp.h>
 
-int main(int argc, char **argv)
+#define SWEEPS_PER_BLOCK 10 // sweeps averaged into each block mean
+#define WINDOW_BLOCKS 16    // block means each chain keeps for the running estimates
+#define ENERGY_BUFFER_ROWS 256 // energies per write to the .npy files
+
+// one markov chain for the automatic equilibration mode, only a window of recent block means is kept
+typedef struct {
+    state_t lattice[TIME_LEN * SPACE_STATE_COUNT];
+    nfold_t *nfold;
+    double energy;
+    double energy_blocks[WINDOW_BLOCKS];
+    double magnetization_blocks[WINDOW_BLOCKS];
+} chain_t;
+
+// allocates the n-fold way buckets for a lattice, or returns NULL when the algorithm doesn't need them
+nfold_t *startAlgorithm(int algorithm, state_t *lattice, double j, double h_mu, double beta)
+{
+    if (algorithm != ALGORITHM_NFOLD)
+        return NULL;
+    return nfoldCreate(lattice, j, h_mu, beta);
+}
+
+void stopAlgorithm(nfold_t *nfold)
+{
+    if (nfold)
+        nfoldDestroy(nfold);
+}
+
+// one sweep's worth of updates with whichever algorithm was started
+double sweep(nfold_t *nfold, state_t *lattice, double energy, double j, double h_mu, double beta)
+{
+    if (nfold)
+        return nfoldAdvance(nfold, energy, SPACE_LEN * TIME_LEN);
+    return metropolis(lattice, energy, j, h_mu, beta, SPACE_LEN * TIME_LEN);
+}
+
+// mean and standard error of the windowed block means of a group of chains
+void windowEstimate(chain_t *chains, int chain_count, int use_magnetization, double *mean, double *error)
+{
+    double sum = 0, sum_squares = 0;
+    int n = chain_count * WINDOW_BLOCKS;
+    for (int c = 0; c < chain_count; c++) {
+        double *blocks = use_magnetization ? chains[c].magnetization_blocks : chains[c].energy_blocks;
+        for (int b = 0; b < WINDOW_BLOCKS; b++) {
+            sum += blocks[b];
+            sum_squares += blocks[b] * blocks[b];
+        }
+    }
+    *mean = sum / n;
+    *error = sqrt(fmax(sum_squares / n - *mean * *mean, 0) / (n - 1));
+}
+
+// runs the hot and cold chains side by side until their windowed energy and |m| estimates
+// agree within tolerance standard errors, returns the sweeps that took or 0 if they never did
+unsigned long equilibrate(int algorithm, double j, double h_mu, double beta, unsigned long max_sweeps, int replicas, double tolerance)
 {
-    if (argc != 5) {
-        fprintf(stderr, "usage: %s <j> <h*mu> <beta> <iterations>\n", argv[0]);
+    int chain_count = 2 * replicas;
+    chain_t *chains = calloc(chain_count, sizeof(chain_t));
+    if (!chains) {
+        fprintf(stderr, "Error allocating chains, abort!\n");
         exit(EXIT_FAILURE);
     }
+    chain_t *hot_chains = chains, *cold_chains = chains + replicas;
+
+    unsigned long equilibrated = 0, blocks = 0;
+    int done = 0;
+
+#pragma omp threadprivate(xorshift_state)
+#pragma omp parallel num_threads(chain_count)
+    {
+        for (int i = 0; i < omp_get_thread_num(); i++)
+            jump();
+
+        // a thread steps several chains when the runtime grants fewer threads than chains
+#pragma omp for
+        for (int c = 0; c < chain_count; c++) {
+            chain_t *chain = &chains[c];
+            if (chain < cold_chains)
+                initLattice(chain->lattice);
+            chain->energy = hamiltonian(chain->lattice, j, h_mu);
+            chain->nfold = startAlgorithm(algorithm, chain->lattice, j, h_mu, beta);
+        }
+
+        while (!done) {
+#pragma omp for
+            for (int c = 0; c < chain_count; c++) {
+                chain_t *chain = &chains[c];
+                double energy_sum = 0, magnetization_sum = 0;
+                for (int s = 0; s < SWEEPS_PER_BLOCK; s++) {
+                    chain->energy = sweep(chain->nfold, chain->lattice, chain->energy, j, h_mu, beta);
+                    energy_sum += chain->energy / (SPACE_LEN * TIME_LEN);
+                    magnetization_sum += abs(magnetization(chain->lattice)) / (double)(SPACE_LEN * TIME_LEN);
+                }
+                chain->energy_blocks[blocks % WINDOW_BLOCKS] = energy_sum / SWEEPS_PER_BLOCK;
+                chain->magnetization_blocks[blocks % WINDOW_BLOCKS] = magnetization_sum / SWEEPS_PER_BLOCK;
+            }
+#pragma omp single
+            {
+                blocks++;
+                unsigned long sweeps = blocks * SWEEPS_PER_BLOCK;
+                if (blocks >= WINDOW_BLOCKS) {
+                    int agree = 1;
+                    for (int m = 0; m < 2; m++) {
+                        double hot_mean, hot_error, cold_mean, cold_error;
+                        windowEstimate(hot_chains, replicas, m, &hot_mean, &hot_error);
+                        windowEstimate(cold_chains, replicas, m, &cold_mean, &cold_error);
+                        agree &= fabs(hot_mean - cold_mean) <= tolerance * hypot(hot_error, cold_error);
+                    }
+                    if (agree)
+                        equilibrated = sweeps;
+                }
+                done = equilibrated || sweeps >= max_sweeps;
+            }
+        }
+    }
+
+    for (int c = 0; c < chain_count; c++)
+        stopAlgorithm(chains[c].nfold);
+    free(chains);
+    return equilibrated;
+}
+
+void usage(char *program_name)
+{
+    fprintf(stderr, "usage: %s [-a metropolis|nfold] <j> <h*mu> <beta> <iterations>\n"
+            "       %s [-a metropolis|nfold] <j> <h*mu> <beta> <max sweeps> <replicas> <tolerance>\n",
+            program_name, program_name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    char *program_name = argv[0];
+    int algorithm = ALGORITHM_METROPOLIS;
+
+    int option;
+    while ((option = getopt(argc, argv, "a:")) != -1) {
+        switch (option) {
+        case 'a':
+            algorithm = parseAlgorithm(optarg, "algorithm");
+            if (algorithm == ALGORITHM_DEMON) {
+                fprintf(stderr, "the demon engine doesn't track the lattice energy, use metropolis or nfold\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            usage(program_name);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (argc != 5 && argc != 7)
+        usage(program_name);
 
     double j    = parseDouble(argv[1], "j");
     double h_mu = parseDouble(argv[2], "h_mu");
@@ -19,28 +169,62 @@ int main(int argc, char **argv)
     
     unsigned long iterations = parseUnsignedLong(argv[4], "iterations");
 
+    if (argc == 7) {
+        int replicas     = parseUnsignedLong(argv[5], "replicas");
+        double tolerance = parseDouble(argv[6], "tolerance");
+        if (replicas < 1) {
+            fprintf(stderr, "need at least one replica\n");
+            exit(EXIT_FAILURE);
+        }
+
+        unsigned long sweeps = equilibrate(algorithm, j, h_mu, beta, iterations, replicas, tolerance);
+        if (!sweeps) {
+            printf("not equilibrated after %lu sweeps\n", iterations);
+            return EXIT_FAILURE;
+        }
+        // generate_states counts single spin updates rather than sweeps
+        printf("equilibrated after %lu sweeps (%lu iterations)\n", sweeps, sweeps * SPACE_LEN * TIME_LEN);
+        return EXIT_SUCCESS;
+    }
+
     state_t hot_lattice[TIME_LEN * SPACE_STATE_COUNT]  = { 0 };
     state_t cold_lattice[TIME_LEN * SPACE_STATE_COUNT] = { 0 };
 
     // fill hot_lattice with random spins
     initLattice(hot_lattice);
 
-    npy_array_t hot_energies  = createNpyDoubleArray1D(iterations);
-    npy_array_t cold_energies = createNpyDoubleArray1D(iterations);
+    // the energies are streamed to disk as they are produced, so memory doesn't grow with
+    // the number of iterations and the files can be plotted while the run is going
+    npy_stream_t hot_energies, cold_energies;
+    if (npyStreamOpen(&hot_energies, "hot_energies.npy", 'f', sizeof(double), 0, ENERGY_BUFFER_ROWS, 1)
+            || npyStreamOpen(&cold_energies, "cold_energies.npy", 'f', sizeof(double), 0, ENERGY_BUFFER_ROWS, 1)) {
+        perror("error opening energy files");
+        exit(EXIT_FAILURE);
+    }
 
-    // iterate the metropolis algorithm, saving the energies of the hot and cold
+    // iterate the chosen algorithm, saving the energies of the hot and cold
     // lattices to the numpy arrays for later graphing
     double hot_energy  = hamiltonian(hot_lattice, j, h_mu);
     double cold_energy = hamiltonian(cold_lattice, j, h_mu);
+    nfold_t *hot_nfold  = startAlgorithm(algorithm, hot_lattice, j, h_mu, beta);
+    nfold_t *cold_nfold = startAlgorithm(algorithm, cold_lattice, j, h_mu, beta);
     for (unsigned long i = 0; i < iterations; i++) {
-        ((double *)(hot_energies.data))[i] = hot_energy / (SPACE_LEN * TIME_LEN);
-        hot_energy  = metropolis(hot_lattice, hot_energy, j, h_mu, beta, SPACE_LEN * TIME_LEN);
-        ((double *)(cold_energies.data))[i] = cold_energy / (SPACE_LEN * TIME_LEN);
-        cold_energy = metropolis(cold_lattice, cold_energy, j, h_mu, beta, SPACE_LEN * TIME_LEN);
+        double hot_per_site  = hot_energy / (SPACE_LEN * TIME_LEN);
+        double cold_per_site = cold_energy / (SPACE_LEN * TIME_LEN);
+        if (npyStreamAppend(&hot_energies, &hot_per_site) || npyStreamAppend(&cold_energies, &cold_per_site)) {
+            fprintf(stderr, "error writing energies\n");
+            exit(EXIT_FAILURE);
+        }
+        hot_energy  = sweep(hot_nfold, hot_lattice, hot_energy, j, h_mu, beta);
+        cold_energy = sweep(cold_nfold, cold_lattice, cold_energy, j, h_mu, beta);
     }
+    stopAlgorithm(hot_nfold);
+    stopAlgorithm(cold_nfold);
 
-    npy_array_save("hot_energies.npy", &hot_energies);
-    npy_array_save("cold_energies.npy", &cold_energies);
+    if (npyStreamClose(&hot_energies) || npyStreamClose(&cold_energies)) {
+        fprintf(stderr, "error writing energies\n");
+        exit(EXIT_FAILURE);
+    }
 
     printf("hot: %f, cold: %f\n", hot_energy, cold_energy);
 
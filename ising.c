@@ -5,6 +5,7 @@
 #include <math.h>
 #include "endian.h"
 #include "popcount.h"
+#include "rng.h"
 #include "npy_array/npy_array.h"
 
 // just some random bytes I grabbed off RANDOM.org
@@ -35,14 +36,44 @@ uint64_t xorshift256()
     return result;
 }
 
+// yoinked from David Blackman and Sebastiano Vigna's excellent 'PRNG shootout' page (CC0)
+// equivalent to calling xorshift256() 2^128 times
+void jump()
+{
+    static const uint64_t JUMP[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+
+    uint64_t s0 = 0;
+    uint64_t s1 = 0;
+    uint64_t s2 = 0;
+    uint64_t s3 = 0;
+    for(int i = 0; i < sizeof(JUMP) / sizeof(*JUMP); i++)
+        for(int b = 0; b < 64; b++) {
+            if (JUMP[i] & UINT64_C(1) << b) {
+                s0 ^= xorshift_state[0];
+                s1 ^= xorshift_state[1];
+                s2 ^= xorshift_state[2];
+                s3 ^= xorshift_state[3];
+            }
+            xorshift256();    
+        }
+        
+    xorshift_state[0] = s0;
+    xorshift_state[1] = s1;
+    xorshift_state[2] = s2;
+    xorshift_state[3] = s3;
+}
+
 int randomInt(int lower, int upper)
 {
-    int modulo = upper - lower;
-    uint64_t random = xorshift256();
-    uint64_t unbiased_max = 0xffffffffffffffff - (0xffffffffffffffff % modulo + 1) % modulo;
-    while (__builtin_expect(random > unbiased_max, 0))
-        random = xorshift256();
-    return lower + random % modulo;
+    // Lemire's multiply-shift, see rngBounded()
+    uint32_t range = upper - lower;
+    uint64_t product = (xorshift256() >> 32) * range;
+    if (__builtin_expect((uint32_t)product < range, 0)) {
+        uint32_t threshold = -range % range;
+        while ((uint32_t)product < threshold)
+            product = (xorshift256() >> 32) * range;
+    }
+    return lower + (int)(product >> 32);
 }
 
 double uniformFloat()
@@ -103,17 +134,15 @@ void printLattice(state_t *lattice)
     }
 }
 
-double hamiltonian(state_t *lattice, double j, double h_mu)
+int bondSum(state_t *lattice)
 {
     // multiply horizontally
     int horizontal_energy = 0;
-    int total_spins = 0;
     for (int i = 0; i < TIME_LEN; i++) {
         state_t last_carry = lattice[(i + 1) * SPACE_STATE_COUNT - 1] << (SPINS_PER_STATE_T - 1);
         for (int j = 0; j < SPACE_STATE_COUNT; j++) {
             state_t this_state = lattice[i * SPACE_STATE_COUNT + j];
             horizontal_energy += popcount(~((last_carry | this_state >> 1) ^ this_state));
-            total_spins += popcount(this_state);
             last_carry = this_state << (SPINS_PER_STATE_T - 1);
         }
     }
@@ -132,7 +161,20 @@ double hamiltonian(state_t *lattice, double j, double h_mu)
     // Same deal here
     vertical_energy = 2 * vertical_energy - TIME_LEN * SPACE_LEN;
 
-    return -j * (horizontal_energy + vertical_energy) - h_mu * (2 * total_spins - TIME_LEN * SPACE_LEN);
+    return horizontal_energy + vertical_energy;
+}
+
+int magnetization(state_t *lattice)
+{
+    int total_spins = 0;
+    for (int i = 0; i < TIME_LEN * SPACE_STATE_COUNT; i++)
+        total_spins += popcount(lattice[i]);
+    return 2 * total_spins - TIME_LEN * SPACE_LEN;
+}
+
+double hamiltonian(state_t *lattice, double j, double h_mu)
+{
+    return -j * bondSum(lattice) - h_mu * magnetization(lattice);
 }
 
 double hamiltonianDebug(state_t *lattice, double j, double h_mu)
@@ -164,14 +206,17 @@ double calculateEnergyChange(state_t *lattice, double j, double h_mu, int x, int
 
 double metropolis(state_t *lattice, double energy, double j, double h_mu, double beta, int iterations)
 {
+    rng_t rng;
+    rngSeed(&rng);
     for (int i = 0; i < iterations; i++) {
-        // first, pick a random point in spacetime
-        int x = randomInt(0, SPACE_LEN);
-        int t = randomInt(0, TIME_LEN);
+        // first, pick a random point in spacetime, one bounded draw covers both coordinates
+        uint32_t site = rngBounded(&rng, SPACE_LEN * TIME_LEN);
+        int x = site % SPACE_LEN;
+        int t = site / SPACE_LEN;
 
         double delta = calculateEnergyChange(lattice, j, h_mu, x, t);
 
-        if (uniformFloat() <= exp(-beta * delta)) {
+        if (rngUniform(&rng) <= exp(-beta * delta)) {
             flipSpinAt(lattice, x, t);
             energy += delta;
         }
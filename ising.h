@@ -16,12 +16,22 @@ typedef int spin_t;       // the type used to represent a single spin
 //      | 2, 3
 //      v
 
+// update algorithms that the programs can be told to use
+enum {
+    ALGORITHM_METROPOLIS,
+    ALGORITHM_NFOLD,
+    ALGORITHM_DEMON,
+};
+
 extern uint64_t xorshift_state[4];
 #pragma omp threadprivate(xorshift_state)
 
 // xorshiro256** PRNG
 uint64_t xorshift256();
 
+// advances the PRNG by 2^128 steps, used to give each thread its own stream
+void jump();
+
 // generates a random number on the interval [lower, upper)
 int randomInt(int lower, int upper);
 
@@ -41,6 +51,13 @@ void flipSpinAt(state_t *lattice, int x, int t);
 
 void printLattice(state_t *lattice);
 
+// sum of s_i * s_j over all nearest neighbour bonds, an exact integer
+int bondSum(state_t *lattice);
+
+// sum of all the spins, an exact integer
+int magnetization(state_t *lattice);
+
+// H = -j * bondSum() - h_mu * magnetization()
 double hamiltonian(state_t *lattice, double j, double h_mu);
 
 double calculateEnergyChange(state_t *lattice, double j, double h_mu, int x, int t);
@@ -0,0 +1,131 @@
+#include "nfold.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// same neighbours as calculateEnergyChange(), up and down first
+static inline int siteClass(state_t *lattice, int x, int t)
+{
+    int sum = getSpinAt(lattice, x, t - 1) + getSpinAt(lattice, x, t + 1)
+        + getSpinAt(lattice, x - 1, t) + getSpinAt(lattice, x + 1, t);
+    return (getSpinAt(lattice, x, t) + 1) / 2 * 5 + (sum + 4) / 2;
+}
+
+static inline void addToBucket(nfold_t *nfold, int site, int class)
+{
+    nfold->classes[site] = class;
+    nfold->positions[site] = nfold->counts[class];
+    nfold->buckets[class * NFOLD_SITES + nfold->counts[class]++] = site;
+}
+
+// swaps the last site of the bucket into the hole
+static inline void removeFromBucket(nfold_t *nfold, int site)
+{
+    int class = nfold->classes[site];
+    int last = nfold->buckets[class * NFOLD_SITES + --nfold->counts[class]];
+    nfold->buckets[class * NFOLD_SITES + nfold->positions[site]] = last;
+    nfold->positions[last] = nfold->positions[site];
+}
+
+static inline void reclassify(nfold_t *nfold, int x, int t)
+{
+    x = (x + SPACE_LEN) % SPACE_LEN;
+    t = (t + TIME_LEN) % TIME_LEN;
+    int site = t * SPACE_LEN + x;
+    int class = siteClass(nfold->lattice, x, t);
+    if (class != nfold->classes[site]) {
+        removeFromBucket(nfold, site);
+        addToBucket(nfold, site, class);
+    }
+}
+
+void nfoldInit(nfold_t *nfold, state_t *lattice, double j, double h_mu, double beta)
+{
+    nfold->lattice = lattice;
+    nfold->time = 0;
+    nfold->buckets = malloc(sizeof(int) * NFOLD_CLASSES * NFOLD_SITES);
+    if (!nfold->buckets) {
+        fprintf(stderr, "Error allocating n-fold way buckets, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    rngSeed(&nfold->rng);
+
+    for (int class = 0; class < NFOLD_CLASSES; class++) {
+        int center = class / 5 * 2 - 1;
+        int sum = class % 5 * 2 - 4;
+        // the same expression as calculateEnergyChange()
+        nfold->deltas[class] = 2.0 * (j * (double)(center * sum) + h_mu * center);
+        nfold->rates[class] = fmin(1, exp(-beta * nfold->deltas[class]));
+        nfold->counts[class] = 0;
+    }
+
+    for (int t = 0; t < TIME_LEN; t++)
+        for (int x = 0; x < SPACE_LEN; x++)
+            addToBucket(nfold, t * SPACE_LEN + x, siteClass(lattice, x, t));
+}
+
+void nfoldFree(nfold_t *nfold)
+{
+    free(nfold->buckets);
+}
+
+nfold_t *nfoldCreate(state_t *lattice, double j, double h_mu, double beta)
+{
+    // malloc only promises 16 byte alignment, and aligned_alloc needs a multiple of the alignment
+    size_t alignment = _Alignof(nfold_t);
+    nfold_t *nfold = aligned_alloc(alignment, (sizeof(nfold_t) + alignment - 1) / alignment * alignment);
+    if (!nfold) {
+        fprintf(stderr, "Error allocating n-fold way state, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    nfoldInit(nfold, lattice, j, h_mu, beta);
+    return nfold;
+}
+
+void nfoldDestroy(nfold_t *nfold)
+{
+    nfoldFree(nfold);
+    free(nfold);
+}
+
+double nfoldAdvance(nfold_t *nfold, double energy, double iterations)
+{
+    double remaining = iterations;
+    for (;;) {
+        double weights[NFOLD_CLASSES], total = 0;
+        for (int class = 0; class < NFOLD_CLASSES; class++) {
+            weights[class] = nfold->counts[class] * nfold->rates[class];
+            total += weights[class];
+        }
+
+        // each metropolis iteration flips with probability total / N, so the wait
+        // until the next flip is exponential with that rate
+        double wait = total > 0 ? -log(1 - rngUniform(&nfold->rng)) * NFOLD_SITES / total : INFINITY;
+        if (wait > remaining) {
+            // memoryless, so the time left over is simply dropped
+            nfold->time += remaining;
+            return energy;
+        }
+        remaining -= wait;
+        nfold->time += wait;
+
+        double target = rngUniform(&nfold->rng) * total;
+        int class = 0;
+        while (class < NFOLD_CLASSES - 1 && (target -= weights[class]) >= 0)
+            class++;
+        // rounding can land on an empty class at the very end
+        while (nfold->counts[class] == 0)
+            class--;
+
+        int site = nfold->buckets[class * NFOLD_SITES + rngBounded(&nfold->rng, nfold->counts[class])];
+        int x = site % SPACE_LEN, t = site / SPACE_LEN;
+        flipSpinAt(nfold->lattice, x, t);
+        energy += nfold->deltas[class];
+
+        reclassify(nfold, x, t);
+        reclassify(nfold, x, t - 1);
+        reclassify(nfold, x, t + 1);
+        reclassify(nfold, x - 1, t);
+        reclassify(nfold, x + 1, t);
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "ising.h"
+#include "rng.h"
+
+#define NFOLD_SITES (SPACE_LEN * TIME_LEN)
+// a site's flip only depends on its own spin and the sum of its 4 neighbours,
+// so there are 2 x 5 classes of site
+#define NFOLD_CLASSES 10
+
+// rejection free n-fold way (Bortz, Kalos and Lebowitz) state for one lattice. sites are
+// kept in one bucket per class, so a flip can be picked directly with the class weights
+typedef struct {
+    state_t *lattice;
+    double time;                    // elapsed time, in attempted single spin updates
+    double deltas[NFOLD_CLASSES];   // energy change of flipping a site of each class
+    double rates[NFOLD_CLASSES];    // metropolis acceptance of each class
+    int counts[NFOLD_CLASSES];
+    int classes[NFOLD_SITES];       // class of every site
+    int positions[NFOLD_SITES];     // index of every site within its bucket
+    int *buckets;                   // NFOLD_CLASSES rows of NFOLD_SITES sites
+    rng_t rng;
+} nfold_t;
+
+// sorts every site of the lattice into its bucket, the lattice is updated in place afterwards
+void nfoldInit(nfold_t *nfold, state_t *lattice, double j, double h_mu, double beta);
+
+void nfoldFree(nfold_t *nfold);
+
+// allocates and initializes an nfold_t, which is too big for the stack and has to be aligned for its rng_t
+nfold_t *nfoldCreate(state_t *lattice, double j, double h_mu, double beta);
+
+// frees an nfold_t from nfoldCreate()
+void nfoldDestroy(nfold_t *nfold);
+
+// advances by the same amount of time that metropolis() would take for the given number
+// of iterations, flipping one spin per event with no rejections. returns the new energy
+double nfoldAdvance(nfold_t *nfold, double energy, double iterations);
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <string.h>
+#include "ising.h"
 
 double parseDouble(char *arg, const char *arg_name)
 {
@@ -28,3 +30,15 @@ unsigned long parseUnsignedLong(char *arg, const char *arg_name)
     }
     return num;
 }
+
+int parseAlgorithm(char *arg, const char *arg_name)
+{
+    if (strcmp(arg, "metropolis") == 0)
+        return ALGORITHM_METROPOLIS;
+    if (strcmp(arg, "nfold") == 0)
+        return ALGORITHM_NFOLD;
+    if (strcmp(arg, "demon") == 0)
+        return ALGORITHM_DEMON;
+    fprintf(stderr, "%s must be one of metropolis, nfold or demon, got %s\n", arg_name, arg);
+    exit(EXIT_FAILURE);
+}
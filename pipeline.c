@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <omp.h>
+#include "ising.h"
+#include "record.h"
+#include "binning.h"
+#include "correlator.h"
+#include "engine.h"
+#include "parse_args.h"
+
+#define LATTICE_STATE_COUNT (TIME_LEN * SPACE_STATE_COUNT)
+// handed to each analyser once every lattice has been generated
+#define SLOT_DONE -1
+
+// fifo of lattice slot indices. the free and full queues together never hold more than
+// the number of slots plus the end markers, so a push never has to wait
+typedef struct {
+    int *items;
+    int capacity;
+    int head;
+    int length;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+} slot_queue_t;
+
+// time each thread spent working and waiting on a queue
+typedef struct {
+    unsigned long lattices;
+    double busy;
+    double waiting;
+} stage_stats_t;
+
+void slotQueueInit(slot_queue_t *queue, int capacity)
+{
+    queue->items = malloc(sizeof(int) * capacity);
+    if (!queue->items) {
+        fprintf(stderr, "Error allocating slot queue, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->length = 0;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+}
+
+void slotQueueFree(slot_queue_t *queue)
+{
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->not_empty);
+    free(queue->items);
+}
+
+void slotQueuePush(slot_queue_t *queue, int slot)
+{
+    pthread_mutex_lock(&queue->mutex);
+    queue->items[(queue->head + queue->length++) % queue->capacity] = slot;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// blocks until there is a slot, the time spent blocked is added to waiting
+int slotQueuePop(slot_queue_t *queue, double *waiting)
+{
+    double start = omp_get_wtime();
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->length == 0)
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    int slot = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->length--;
+    pthread_mutex_unlock(&queue->mutex);
+    *waiting += omp_get_wtime() - start;
+    return slot;
+}
+
+// totals of one stage, rates are per second of wall time and per second of a thread's work
+void printStage(const char *name, stage_stats_t *stats, int threads, double wall, const char *waiting_for)
+{
+    stage_stats_t total = { 0 };
+    for (int i = 0; i < threads; i++) {
+        total.lattices += stats[i].lattices;
+        total.busy += stats[i].busy;
+        total.waiting += stats[i].waiting;
+    }
+    printf("%s: %d threads, %lu lattices, %.1f lattices/s, %.1f lattices/s per thread, %.1f%% of the time waiting for %s\n",
+            name, threads, total.lattices, total.lattices / wall,
+            total.busy > 0 ? total.lattices / total.busy : 0,
+            100 * total.waiting / (wall * threads), waiting_for);
+}
+
+void usage(char *program_name)
+{
+    fprintf(stderr, "usage: %s [-a metropolis|nfold|demon] [-o states.isi] [-b bins] [-r resamples] <j> <h*mu> <beta> <iterations> <count> <generators> <analysers> <slots> <outfile>\n", program_name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    char *program_name = argv[0];
+    char *states_filename = NULL;
+    int algorithm = ALGORITHM_METROPOLIS;
+    int max_bins = DEFAULT_BINS, resamples = DEFAULT_RESAMPLES;
+
+    int option;
+    while ((option = getopt(argc, argv, "a:o:b:r:")) != -1) {
+        switch (option) {
+        case 'a':
+            algorithm = parseAlgorithm(optarg, "algorithm");
+            break;
+        case 'o':
+            states_filename = optarg;
+            break;
+        case 'b':
+            max_bins = parseUnsignedLong(optarg, "bins");
+            break;
+        case 'r':
+            resamples = parseUnsignedLong(optarg, "resamples");
+            break;
+        default:
+            usage(program_name);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (argc != 10)
+        usage(program_name);
+
+    double j    = parseDouble(argv[1], "j");
+    double h_mu = parseDouble(argv[2], "h_mu");
+    double beta = parseDouble(argv[3], "beta");
+
+    unsigned long iterations = parseUnsignedLong(argv[4], "iterations");
+    unsigned long count      = parseUnsignedLong(argv[5], "count");
+    int generators = parseUnsignedLong(argv[6], "generators");
+    int analysers  = parseUnsignedLong(argv[7], "analysers");
+    int slots      = parseUnsignedLong(argv[8], "slots");
+
+    char *filename = argv[9];
+
+    if (algorithm == ALGORITHM_DEMON && (h_mu != 0 || j == 0)) {
+        fprintf(stderr, "the demon engine needs h_mu = 0 and j != 0\n");
+        exit(EXIT_FAILURE);
+    }
+    if (generators < 1 || analysers < 1 || slots < 1) {
+        fprintf(stderr, "need at least one generator, analyser and slot\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // writing the states is optional, the analysis never reads them back
+    FILE *data_file = NULL;
+    if (states_filename) {
+        data_file = fopen(states_filename, "w");
+        if (!data_file) {
+            perror("error opening file");
+            exit(EXIT_FAILURE);
+        }
+        if (writeHeader(data_file, j, beta)) {
+            fprintf(stderr, "error writing to file\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // the ring of reusable lattices, each one is either free or full and waiting for an analyser
+    state_t *lattices = malloc(sizeof(state_t) * LATTICE_STATE_COUNT * slots);
+    stage_stats_t *stats = calloc(generators + analysers, sizeof(stage_stats_t));
+    if (!lattices || !stats) {
+        fprintf(stderr, "Error allocating lattice slots, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    slot_queue_t free_slots, full_slots;
+    slotQueueInit(&free_slots, slots);
+    slotQueueInit(&full_slots, slots + analysers);
+    for (int slot = 0; slot < slots; slot++)
+        slotQueuePush(&free_slots, slot);
+
+    binning_t binning;
+    binningInit(&binning, OBSERVABLE_COUNT, max_bins);
+
+    unsigned long next_lattice = 0;
+    int finished_generators = 0;
+    double start = omp_get_wtime();
+
+    // every thread has to be running at once, or a stage could wait on one that never starts
+    omp_set_dynamic(0);
+#pragma omp threadprivate(xorshift_state)
+#pragma omp parallel num_threads(generators + analysers)
+    {
+        int thread = omp_get_thread_num();
+        if (omp_get_num_threads() != generators + analysers) {
+#pragma omp single
+            {
+                fprintf(stderr, "could only start %d threads\n", omp_get_num_threads());
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (int i = 0; i < thread; i++)
+            jump();
+        stage_stats_t *own = &stats[thread];
+
+        if (thread < generators) {
+            for (;;) {
+                unsigned long i;
+#pragma omp atomic capture
+                i = next_lattice++;
+                if (i >= count)
+                    break;
+
+                int slot = slotQueuePop(&free_slots, &own->waiting);
+                double work_start = omp_get_wtime();
+                state_t *lattice = lattices + (size_t)slot * LATTICE_STATE_COUNT;
+                initLattice(lattice);
+                advanceLattice(algorithm, lattice, j, h_mu, beta, iterations, NULL);
+                own->busy += omp_get_wtime() - work_start;
+                own->lattices++;
+                slotQueuePush(&full_slots, slot);
+            }
+
+            // the last generator out tells every analyser to stop
+            int finished;
+#pragma omp atomic capture
+            finished = ++finished_generators;
+            if (finished == generators)
+                for (int i = 0; i < analysers; i++)
+                    slotQueuePush(&full_slots, SLOT_DONE);
+        }
+        else {
+            complex double *sample = malloc(sizeof(complex double) * OBSERVABLE_COUNT);
+            if (!sample) {
+                fprintf(stderr, "Error allocating sample, abort!\n");
+                exit(EXIT_FAILURE);
+            }
+            int slot;
+            while ((slot = slotQueuePop(&full_slots, &own->waiting)) != SLOT_DONE) {
+                double work_start = omp_get_wtime();
+                state_t *lattice = lattices + (size_t)slot * LATTICE_STATE_COUNT;
+                correlatorSample(lattice, sample);
+                // same as generate_states, writeState() is a single fwrite
+                if (data_file && writeState(data_file, lattice)) {
+                    fprintf(stderr, "error writing to file\n");
+                    exit(EXIT_FAILURE);
+                }
+                // the lattice is not needed anymore, so hand it back before taking the lock
+                slotQueuePush(&free_slots, slot);
+#pragma omp critical(binning)
+                binningAdd(&binning, sample);
+                own->busy += omp_get_wtime() - work_start;
+                own->lattices++;
+            }
+            free(sample);
+        }
+    }
+    double wall = omp_get_wtime() - start;
+
+    if (data_file)
+        fclose(data_file);
+
+    // a stage that spends most of its time waiting should give threads to the other one
+    printStage("generators", stats, generators, wall, "a free slot");
+    printStage("analysers", stats + generators, analysers, wall, "a full slot");
+    printf("%lu states in %d bins of %lu\n", binning.samples, binning.bin_count, binning.block_size);
+
+    if (binning.samples == 0) {
+        fprintf(stderr, "no states generated\n");
+        exit(EXIT_FAILURE);
+    }
+    if (correlatorSave(filename, &binning, resamples)) {
+        fprintf(stderr, "error saving array list\n");
+        exit(EXIT_FAILURE);
+    }
+
+    binningFree(&binning);
+    slotQueueFree(&free_slots);
+    slotQueueFree(&full_slots);
+    free(stats);
+    free(lattices);
+
+    return EXIT_SUCCESS;
+}
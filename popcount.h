@@ -1,7 +1,7 @@
 #pragma once
 #include "ising.h"
 
-int bitcount_lookup[] = {
+static const int bitcount_lookup[] = {
     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
     1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
     1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
@@ -20,7 +20,7 @@ int bitcount_lookup[] = {
     4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8,
 };
 
-int count1sInState(state_t n)
+static inline int count1sInState(state_t n)
 {
     int count = 0;
     for (int i = 0; i < sizeof(state_t); i++)
@@ -7,6 +7,8 @@
 #include <stdarg.h>
 
 static const int8_t file_ver_identifier[] = "ISI\x01";
+// version 2 files hold block spin coarse grained lattices, the header has an extra block factor
+static const int8_t blocked_ver_identifier[] = "ISI\x02";
 
 npy_array_t createNpyArrayNdVaList(char typechar, int type_size, int ndim, va_list vararg)
 {
@@ -66,9 +68,168 @@ npy_array_t createNpyArrayNd(char typechar, int type_size, int ndim, ...)
     return createNpyArrayNdVaList(typechar, type_size, ndim, vararg);
 }
 
-int writeHeader(FILE *fp, double j, double beta)
+// wide enough for any size_t, so the row count can be patched in place
+#define NPY_STREAM_COUNT_WIDTH 20
+
+// the data goes to disk before the header claims it, so a reader never sees missing rows
+static int npyStreamWrite(npy_stream_t *stream, const char *data, size_t rows)
+{
+    if (fwrite(data, stream->row_size, rows, stream->fp) != rows || fflush(stream->fp))
+        return -1;
+    stream->rows += rows;
+
+    long end = ftell(stream->fp);
+    if (fseek(stream->fp, stream->shape_offset, SEEK_SET)
+            || fprintf(stream->fp, "%*zu", NPY_STREAM_COUNT_WIDTH, stream->rows) != NPY_STREAM_COUNT_WIDTH
+            || fseek(stream->fp, end, SEEK_SET)
+            || fflush(stream->fp))
+        return -1;
+    return 0;
+}
+
+static void *npyStreamWriter(void *arg)
+{
+    npy_stream_t *stream = arg;
+    pthread_mutex_lock(&stream->mutex);
+    for (;;) {
+        while (!stream->pending && !stream->stop)
+            pthread_cond_wait(&stream->cond, &stream->mutex);
+        if (!stream->pending)
+            break;
+
+        char *data = stream->pending;
+        size_t rows = stream->pending_rows;
+        pthread_mutex_unlock(&stream->mutex);
+        int error = npyStreamWrite(stream, data, rows);
+        pthread_mutex_lock(&stream->mutex);
+
+        stream->error |= error;
+        stream->spare = data;
+        stream->pending = NULL;
+        pthread_cond_broadcast(&stream->cond);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return NULL;
+}
+
+// hands the active buffer over to be written, either directly or to the writer thread
+static int npyStreamSubmit(npy_stream_t *stream)
+{
+    if (stream->buffered == 0)
+        return 0;
+
+    if (!stream->async) {
+        int error = npyStreamWrite(stream, stream->buffer, stream->buffered);
+        stream->buffered = 0;
+        return error;
+    }
+
+    pthread_mutex_lock(&stream->mutex);
+    while (stream->pending)
+        pthread_cond_wait(&stream->cond, &stream->mutex);
+    stream->pending = stream->buffer;
+    stream->pending_rows = stream->buffered;
+    stream->buffer = stream->spare;
+    stream->spare = NULL;
+    stream->buffered = 0;
+    int error = stream->error;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+    return error;
+}
+
+int npyStreamAppend(npy_stream_t *stream, const void *row)
+{
+    memcpy(stream->buffer + stream->buffered * stream->row_size, row, stream->row_size);
+    if (++stream->buffered == stream->buffer_rows)
+        return npyStreamSubmit(stream);
+    return 0;
+}
+
+int npyStreamFlush(npy_stream_t *stream)
+{
+    int error = npyStreamSubmit(stream);
+    if (stream->async) {
+        pthread_mutex_lock(&stream->mutex);
+        while (stream->pending)
+            pthread_cond_wait(&stream->cond, &stream->mutex);
+        error |= stream->error;
+        pthread_mutex_unlock(&stream->mutex);
+    }
+    return error;
+}
+
+int npyStreamClose(npy_stream_t *stream)
+{
+    int error = stream->fp ? npyStreamFlush(stream) : -1;
+    if (stream->async) {
+        pthread_mutex_lock(&stream->mutex);
+        stream->stop = 1;
+        pthread_cond_broadcast(&stream->cond);
+        pthread_mutex_unlock(&stream->mutex);
+        pthread_join(stream->thread, NULL);
+        pthread_mutex_destroy(&stream->mutex);
+        pthread_cond_destroy(&stream->cond);
+    }
+    if (stream->fp && fclose(stream->fp))
+        error = -1;
+    free(stream->buffer);
+    free(stream->spare);
+    return error;
+}
+
+int npyStreamOpen(npy_stream_t *stream, const char *filename, char typechar, int type_size,
+        int row_length, size_t buffer_rows, int async)
+{
+    *stream = (npy_stream_t) {
+        .row_size = (size_t)type_size * (row_length ? row_length : 1),
+        .buffer_rows = buffer_rows ? buffer_rows : 1, .async = async,
+    };
+    stream->buffer = malloc(stream->buffer_rows * stream->row_size);
+    stream->spare = async ? malloc(stream->buffer_rows * stream->row_size) : NULL;
+    if (!stream->buffer || (async && !stream->spare)) {
+        fprintf(stderr, "Error allocating npy stream buffers, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    stream->fp = fopen(filename, "wb");
+    if (!stream->fp)
+        return -1;
+
+    int endianness = !((uint8_t *)(&(int){1}))[0];
+    char header[256];
+    int shape_start = snprintf(header, sizeof(header), "{'descr': '%c%c%d', 'fortran_order': False, 'shape': (",
+            '<' + 2 * endianness, typechar, type_size);
+    int length = shape_start + snprintf(header + shape_start, sizeof(header) - shape_start, "%*d,", NPY_STREAM_COUNT_WIDTH, 0);
+    if (row_length)
+        length += snprintf(header + length, sizeof(header) - length, " %d", row_length);
+    length += snprintf(header + length, sizeof(header) - length, "), }");
+    // the magic, version and header length take 10 bytes and the whole header has to be a
+    // multiple of 64 long, ending in a newline
+    while ((10 + length + 1) % 64)
+        header[length++] = ' ';
+    header[length++] = '\n';
+
+    uint16_t header_length = htole16(length);
+    if (fwrite("\x93NUMPY\x01\x00", 1, 8, stream->fp) != 8
+            || fwrite(&header_length, sizeof(header_length), 1, stream->fp) != 1
+            || fwrite(header, 1, length, stream->fp) != length
+            || fflush(stream->fp))
+        return -1;
+    stream->shape_offset = 10 + shape_start;
+
+    if (async) {
+        pthread_mutex_init(&stream->mutex, NULL);
+        pthread_cond_init(&stream->cond, NULL);
+        if (pthread_create(&stream->thread, NULL, npyStreamWriter, stream))
+            return -1;
+    }
+    return 0;
+}
+
+static int writeHeaderFields(FILE *fp, const int8_t *identifier, double j, double beta, int time_len, int space_len)
 {
-    if (fwrite(file_ver_identifier, 1, sizeof(file_ver_identifier) - 1, fp) != sizeof(file_ver_identifier) - 1)
+    if (fwrite(identifier, 1, sizeof(file_ver_identifier) - 1, fp) != sizeof(file_ver_identifier) - 1)
         return -1;
 
     // make little endian versions of each to write to file
@@ -79,10 +240,10 @@ int writeHeader(FILE *fp, double j, double beta)
     uint64_t beta_le = htole64(*((uint64_t *)&beta));
     if (fwrite(&beta_le, sizeof(beta_le), 1, fp) != 1)
         return -1;
-    uint16_t lattice_time_len = htole16(TIME_LEN);
+    uint16_t lattice_time_len = htole16(time_len);
     if (fwrite(&lattice_time_len, sizeof(lattice_time_len), 1, fp) != 1)
         return -1;
-    uint16_t lattice_space_len = htole16(SPACE_LEN);
+    uint16_t lattice_space_len = htole16(space_len);
     if (fwrite(&lattice_space_len, sizeof(lattice_space_len), 1, fp) != 1)
         return -1;
     uint16_t state_t_bytes = htole16(sizeof(state_t) * CHAR_BIT / 8);
@@ -92,12 +253,33 @@ int writeHeader(FILE *fp, double j, double beta)
     return 0;
 }
 
+int writeHeader(FILE *fp, double j, double beta)
+{
+    return writeHeaderFields(fp, file_ver_identifier, j, beta, TIME_LEN, SPACE_LEN);
+}
+
+int writeHeaderBlocked(FILE *fp, double j, double beta, int block)
+{
+    if (writeHeaderFields(fp, blocked_ver_identifier, j, beta, TIME_LEN / block, SPACE_LEN / block))
+        return -1;
+    uint16_t block_le = htole16(block);
+    if (fwrite(&block_le, sizeof(block_le), 1, fp) != 1)
+        return -1;
+
+    return 0;
+}
+
 // writes a lattice to the specified FILE *
 // using little-endian byte ordering
 int writeState(FILE *fp, state_t *lattice)
 {
-    state_t buffer[SPACE_STATE_COUNT * TIME_LEN];
-    for (size_t i = 0; i < SPACE_STATE_COUNT * TIME_LEN; i++) {
+    return writeStateSized(fp, lattice, SPACE_STATE_COUNT * TIME_LEN);
+}
+
+int writeStateSized(FILE *fp, state_t *lattice, size_t count)
+{
+    state_t buffer[count];
+    for (size_t i = 0; i < count; i++) {
         // this will get optimized away by the compiler
         switch (sizeof(state_t) * CHAR_BIT) {
         case 64:
@@ -115,21 +297,19 @@ int writeState(FILE *fp, state_t *lattice)
         }
     }
 
-    if (fwrite(buffer, sizeof(state_t), SPACE_STATE_COUNT * TIME_LEN, fp) != SPACE_STATE_COUNT * TIME_LEN)
+    if (fwrite(buffer, sizeof(state_t), count, fp) != count)
         return -1;
 
     return 0;
 }
 
-// read the lattice from the specified FILE pointer
-// assumes all pointers are valid, returns 0 on success
-int readHeader(FILE *fp, double *j, double *beta)
+static int readHeaderFields(FILE *fp, const int8_t *identifier, double *j, double *beta, int time_len, int space_len)
 {
     uint8_t id_str[sizeof(file_ver_identifier) - 1];
     if (fread(id_str, 1, sizeof(id_str), fp) != sizeof(id_str))
         return ERROR_READ;
 
-    if (memcmp(id_str, file_ver_identifier, sizeof(id_str)) != 0)
+    if (memcmp(id_str, identifier, sizeof(id_str)) != 0)
         return ERROR_BAD_PREFIX;
 
     uint64_t j_le;
@@ -145,7 +325,7 @@ int readHeader(FILE *fp, double *j, double *beta)
     uint16_t lattice_time_len;
     if (fread(&lattice_time_len, sizeof(lattice_time_len), 1, fp) != 1)
         return ERROR_READ;
-    if (lattice_time_len != htole16(TIME_LEN)) {
+    if (lattice_time_len != htole16(time_len)) {
         printf("Mismatch size, file has TIME_LEN %d\n", lattice_time_len);
         return ERROR_LATTICE_SIZE;
     }
@@ -153,7 +333,7 @@ int readHeader(FILE *fp, double *j, double *beta)
     uint16_t lattice_space_len;
     if (fread(&lattice_space_len, sizeof(lattice_space_len), 1, fp) != 1)
         return ERROR_READ;
-    if (lattice_space_len != htole16(SPACE_LEN)) {
+    if (lattice_space_len != htole16(space_len)) {
         printf("Mismatch size, file has SPACE_LEN %d\n", lattice_space_len);
         return ERROR_LATTICE_SIZE;
     }
@@ -168,12 +348,41 @@ int readHeader(FILE *fp, double *j, double *beta)
     return READ_SUCCESS;
 }
 
+// read the lattice from the specified FILE pointer
+// assumes all pointers are valid, returns 0 on success
+int readHeader(FILE *fp, double *j, double *beta)
+{
+    return readHeaderFields(fp, file_ver_identifier, j, beta, TIME_LEN, SPACE_LEN);
+}
+
+int readHeaderBlocked(FILE *fp, double *j, double *beta, int block)
+{
+    int error_code = readHeaderFields(fp, blocked_ver_identifier, j, beta, TIME_LEN / block, SPACE_LEN / block);
+    if (error_code != READ_SUCCESS)
+        return error_code;
+
+    uint16_t block_le;
+    if (fread(&block_le, sizeof(block_le), 1, fp) != 1)
+        return ERROR_READ;
+    if (le16toh(block_le) != block) {
+        printf("Mismatch block factor, file has %d\n", le16toh(block_le));
+        return ERROR_LATTICE_SIZE;
+    }
+
+    return READ_SUCCESS;
+}
+
 int readState(FILE *fp, state_t *lattice)
 {
-    if (fread(lattice, sizeof(state_t), SPACE_STATE_COUNT * TIME_LEN, fp) != SPACE_STATE_COUNT * TIME_LEN)
+    return readStateSized(fp, lattice, SPACE_STATE_COUNT * TIME_LEN);
+}
+
+int readStateSized(FILE *fp, state_t *lattice, size_t count)
+{
+    if (fread(lattice, sizeof(state_t), count, fp) != count)
         return ERROR_READ;
     
-    for (int i = 0; i < SPACE_STATE_COUNT * TIME_LEN; i++) {
+    for (int i = 0; i < count; i++) {
         switch (sizeof(state_t) * CHAR_BIT) {
         case 64:
             lattice[i] = le64toh(lattice[i]);
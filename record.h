@@ -2,6 +2,7 @@
 #include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <pthread.h>
 #include "ising.h"
 #include "npy_array/npy_array.h"
 
@@ -21,14 +22,66 @@ npy_array_t createNpyDoubleArrayNd(int count, ...);
 
 npy_array_t createNpyArrayNd(char typechar, int type_size, int ndim, ...);
 
+// a .npy file that rows get appended to while it is open. the shape in the header is
+// rewritten after every batch of rows is on disk, so the file is always a valid
+// array of the rows written so far and can be loaded while the run continues
+typedef struct {
+    FILE *fp;
+    long shape_offset;       // position of the row count in the header
+    size_t row_size;         // bytes per row
+    size_t rows;             // rows on disk
+    size_t buffer_rows;      // capacity of each buffer
+    size_t buffered;         // rows in the active buffer
+    char *buffer;
+
+    // in asynchronous mode full buffers are handed to a writer thread
+    int async;
+    int stop;
+    int error;
+    char *pending;           // buffer the writer thread is working on
+    size_t pending_rows;
+    char *spare;             // the other buffer, while it is not pending
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} npy_stream_t;
+
+// opens a stream of rows of row_length elements, or single elements when row_length is 0.
+// rows are written in batches of buffer_rows, returns 0 on success
+int npyStreamOpen(npy_stream_t *stream, const char *filename, char typechar, int type_size,
+        int row_length, size_t buffer_rows, int async);
+
+// copies one row into the stream
+int npyStreamAppend(npy_stream_t *stream, const void *row);
+
+// gets every row appended so far onto disk, with the header updated to match
+int npyStreamFlush(npy_stream_t *stream);
+
+int npyStreamClose(npy_stream_t *stream);
+
 int writeHeader(FILE *fp, double j, double beta);
 
+// header for a file of block spin coarse grained lattices, which are
+// (SPACE_LEN / block) x (TIME_LEN / block) and tagged with the block factor.
+// their rows are packed back to back, see packRows()
+int writeHeaderBlocked(FILE *fp, double j, double beta, int block);
+
 // writes a lattice to the specified FILE *
 // using little-endian byte ordering
 int writeState(FILE *fp, state_t *lattice);
 
+// same as writeState(), for a lattice of count state_t's
+int writeStateSized(FILE *fp, state_t *lattice, size_t count);
+
 // read the lattice from the specified FILE pointer
 // assumes all pointers are valid, returns 0 on success
 int readHeader(FILE *fp, double *j, double *beta);
 
+// reads a header written by writeHeaderBlocked(), checking that the block factor matches.
+// none of the analysis programs read the coarse grained files yet, correlation assumes
+// a full SPACE_LEN x TIME_LEN lattice
+int readHeaderBlocked(FILE *fp, double *j, double *beta, int block);
+
 int readState(FILE *fp, state_t *lattice);
+
+int readStateSized(FILE *fp, state_t *lattice, size_t count);
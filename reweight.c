@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "ising.h"
+#include "rng.h"
+#include "record.h"
+#include "histogram.h"
+#include "parse_args.h"
+
+#define WHAM_TOLERANCE 1e-10
+#define WHAM_MAX_ITERATIONS 100000
+
+enum {
+    OBSERVABLE_ENERGY,
+    OBSERVABLE_SPECIFIC_HEAT,
+    OBSERVABLE_MAGNETIZATION,
+    OBSERVABLE_SUSCEPTIBILITY,
+    OBSERVABLE_COUNT,
+};
+
+static const char *observable_names[OBSERVABLE_COUNT] = { "energy", "specific_heat", "magnetization", "susceptibility" };
+
+// one simulation, the histogram was sampled with weight exp(-beta * H(j, h_mu))
+typedef struct {
+    double beta;
+    double h_mu;
+    histogram_t histogram;
+} run_t;
+
+// log(sum(exp(values))) without overflowing, -INFINITY entries are allowed
+double logSumExp(const double *values, size_t count)
+{
+    double max = -INFINITY;
+    for (size_t i = 0; i < count; i++)
+        if (values[i] > max)
+            max = values[i];
+    if (max == -INFINITY)
+        return -INFINITY;
+
+    double sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += exp(values[i] - max);
+    return max + log(sum);
+}
+
+// -beta * H for the given bin, so the run's log weight of the bin
+static inline double logBoltzmann(histogram_bin_t *bin, double j, double h_mu, double beta)
+{
+    return beta * (j * bin->bond_sum + h_mu * bin->magnetization);
+}
+
+// Ferrenberg-Swendsen multi-histogram equations, iterated to self consistency.
+// counts holds run_count rows of bins->length entries, the output log_dos is the log
+// density of states per bin (up to a constant) and log_z the log partition function of each run
+void solveWham(histogram_t *bins, int64_t *counts, run_t *runs, int run_count, double j, double *log_dos, double *log_z)
+{
+    size_t bin_count = bins->length;
+    double log_samples[run_count];
+    for (int k = 0; k < run_count; k++) {
+        int64_t samples = 0;
+        for (size_t i = 0; i < bin_count; i++)
+            samples += counts[k * bin_count + i];
+        log_samples[k] = samples ? log(samples) : -INFINITY;
+        log_z[k] = 0;
+    }
+
+    double *terms = malloc(sizeof(double) * (bin_count > run_count ? bin_count : run_count));
+    if (!terms) {
+        fprintf(stderr, "Error allocating memory, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int iteration = 0; iteration < WHAM_MAX_ITERATIONS; iteration++) {
+        for (size_t i = 0; i < bin_count; i++) {
+            int64_t total = 0;
+            for (int k = 0; k < run_count; k++) {
+                total += counts[k * bin_count + i];
+                terms[k] = log_samples[k] + logBoltzmann(&bins->bins[i], j, runs[k].h_mu, runs[k].beta) - log_z[k];
+            }
+            log_dos[i] = total ? log(total) - logSumExp(terms, run_count) : -INFINITY;
+        }
+
+        // the free energies are only defined up to a constant, so pin the first one to zero
+        double change = 0, offset = 0;
+        for (int k = 0; k < run_count; k++) {
+            for (size_t i = 0; i < bin_count; i++)
+                terms[i] = log_dos[i] + logBoltzmann(&bins->bins[i], j, runs[k].h_mu, runs[k].beta);
+            double new_log_z = logSumExp(terms, bin_count);
+            if (k == 0)
+                offset = new_log_z;
+            new_log_z -= offset;
+            change = fmax(change, fabs(new_log_z - log_z[k]));
+            log_z[k] = new_log_z;
+        }
+        if (change < WHAM_TOLERANCE)
+            break;
+    }
+    free(terms);
+}
+
+// reweights the density of states to (beta, h_mu), writing one value per observable
+void reweight(histogram_t *bins, double *log_dos, double j, double h_mu, double beta, double *observables)
+{
+    size_t bin_count = bins->length;
+    double *log_weights = malloc(sizeof(double) * bin_count);
+    if (!log_weights) {
+        fprintf(stderr, "Error allocating memory, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < bin_count; i++)
+        log_weights[i] = log_dos[i] + logBoltzmann(&bins->bins[i], j, h_mu, beta);
+    double log_z = logSumExp(log_weights, bin_count);
+
+    double energy = 0, abs_magnetization = 0;
+    for (size_t i = 0; i < bin_count; i++) {
+        double p = exp(log_weights[i] - log_z);
+        energy += p * (-j * bins->bins[i].bond_sum - h_mu * bins->bins[i].magnetization);
+        abs_magnetization += p * llabs(bins->bins[i].magnetization);
+    }
+
+    // second pass for the fluctuations, so that the variance doesn't suffer from cancellation
+    double energy_variance = 0, magnetization_variance = 0;
+    for (size_t i = 0; i < bin_count; i++) {
+        double p = exp(log_weights[i] - log_z);
+        double delta_e = -j * bins->bins[i].bond_sum - h_mu * bins->bins[i].magnetization - energy;
+        double delta_m = llabs(bins->bins[i].magnetization) - abs_magnetization;
+        energy_variance += p * delta_e * delta_e;
+        magnetization_variance += p * delta_m * delta_m;
+    }
+    free(log_weights);
+
+    const double sites = SPACE_LEN * TIME_LEN;
+    observables[OBSERVABLE_ENERGY]         = energy / sites;
+    observables[OBSERVABLE_SPECIFIC_HEAT]  = beta * beta * energy_variance / sites;
+    observables[OBSERVABLE_MAGNETIZATION]  = abs_magnetization / sites;
+    observables[OBSERVABLE_SUSCEPTIBILITY] = beta * magnetization_variance / sites;
+}
+
+// the value of the i-th point of count evenly spaced points from min to max
+static inline double linearSpace(double min, double max, int count, int i)
+{
+    return count > 1 ? min + (max - min) * i / (count - 1) : min;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 13 || (argc - 10) % 3 != 0) {
+        fprintf(stderr, "usage: %s <j> <beta min> <beta max> <beta count> <h*mu min> <h*mu max> <h*mu count> "
+                "<resamples> <outfile> <beta 1> <h*mu 1> <histogram 1> [<beta 2> <h*mu 2> <histogram 2> ...]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    double j        = parseDouble(argv[1], "j");
+    double beta_min = parseDouble(argv[2], "beta min");
+    double beta_max = parseDouble(argv[3], "beta max");
+    int beta_count  = parseUnsignedLong(argv[4], "beta count");
+    double h_min    = parseDouble(argv[5], "h*mu min");
+    double h_max    = parseDouble(argv[6], "h*mu max");
+    int h_count     = parseUnsignedLong(argv[7], "h*mu count");
+    unsigned long resamples = parseUnsignedLong(argv[8], "resamples");
+    char *out_filename = argv[9];
+
+    if (beta_count == 0 || h_count == 0) {
+        fprintf(stderr, "beta count and h*mu count must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int run_count = (argc - 10) / 3;
+    run_t runs[run_count];
+    histogram_t bins;
+    histogramInit(&bins);
+    for (int k = 0; k < run_count; k++) {
+        runs[k].beta = parseDouble(argv[10 + 3 * k], "beta");
+        runs[k].h_mu = parseDouble(argv[11 + 3 * k], "h*mu");
+        if (histogramLoad(argv[12 + 3 * k], &runs[k].histogram)) {
+            fprintf(stderr, "error loading histogram %s\n", argv[12 + 3 * k]);
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < runs[k].histogram.length; i++)
+            histogramAdd(&bins, runs[k].histogram.bins[i].bond_sum, runs[k].histogram.bins[i].magnetization, 0);
+    }
+    // the union of every run's bins, all of the counts are kept per run below
+    histogramCollapse(&bins);
+    size_t bin_count = bins.length;
+
+    int64_t *counts = calloc(run_count * bin_count, sizeof(int64_t));
+    int64_t *cumulative = calloc(run_count * bin_count, sizeof(int64_t));
+    int64_t *resampled = calloc(run_count * bin_count, sizeof(int64_t));
+    double *log_dos = malloc(sizeof(double) * bin_count);
+    double log_z[run_count];
+    if (!counts || !cumulative || !resampled || !log_dos) {
+        fprintf(stderr, "Error allocating memory, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    // both lists are sorted, so this is just a merge
+    for (int k = 0; k < run_count; k++) {
+        size_t i = 0;
+        for (size_t n = 0; n < runs[k].histogram.length; n++) {
+            histogram_bin_t *bin = &runs[k].histogram.bins[n];
+            while (bins.bins[i].bond_sum != bin->bond_sum || bins.bins[i].magnetization != bin->magnetization)
+                i++;
+            counts[k * bin_count + i] = bin->count;
+        }
+        int64_t running_total = 0;
+        for (size_t i = 0; i < bin_count; i++) {
+            running_total += counts[k * bin_count + i];
+            cumulative[k * bin_count + i] = running_total;
+        }
+    }
+
+    npy_array_t beta_out = createNpyDoubleArray1D(beta_count);
+    npy_array_t h_out = createNpyDoubleArray1D(h_count);
+    npy_array_t value_out[OBSERVABLE_COUNT], error_out[OBSERVABLE_COUNT];
+    for (int o = 0; o < OBSERVABLE_COUNT; o++) {
+        value_out[o] = createNpyDoubleArrayNd(2, beta_count, h_count);
+        error_out[o] = createNpyDoubleArrayNd(2, beta_count, h_count);
+    }
+    for (int b = 0; b < beta_count; b++)
+        ((double *)beta_out.data)[b] = linearSpace(beta_min, beta_max, beta_count, b);
+    for (int h = 0; h < h_count; h++)
+        ((double *)h_out.data)[h] = linearSpace(h_min, h_max, h_count, h);
+
+    solveWham(&bins, counts, runs, run_count, j, log_dos, log_z);
+    for (int b = 0; b < beta_count; b++) {
+        for (int h = 0; h < h_count; h++) {
+            double observables[OBSERVABLE_COUNT];
+            reweight(&bins, log_dos, j, ((double *)h_out.data)[h], ((double *)beta_out.data)[b], observables);
+            for (int o = 0; o < OBSERVABLE_COUNT; o++)
+                ((double *)value_out[o].data)[b * h_count + h] = observables[o];
+        }
+    }
+
+    // bootstrap, every run is resampled with its own number of samples.
+    // the errors are accumulated with welford's algo, the means go in the scratch array
+    double *bootstrap_mean = calloc(OBSERVABLE_COUNT * beta_count * h_count, sizeof(double));
+    if (!bootstrap_mean) {
+        fprintf(stderr, "Error allocating memory, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    // sample counts can go past INT_MAX, so this needs the 64 bit draw
+    rng_t rng;
+    rngSeed(&rng);
+    for (unsigned long r = 0; r < resamples; r++) {
+        for (int k = 0; k < run_count; k++) {
+            histogram_t *histogram = &runs[k].histogram;
+            int64_t samples = histogramSamples(histogram);
+            int64_t *row = resampled + k * bin_count;
+            for (size_t i = 0; i < bin_count; i++)
+                row[i] = 0;
+            for (int64_t s = 0; s < samples; s++) {
+                // pick a sample uniformly, then binary search for the bin it falls into
+                int64_t target = rngBounded64(&rng, samples);
+                size_t lower = 0, upper = bin_count - 1;
+                while (lower < upper) {
+                    size_t middle = (lower + upper) / 2;
+                    if (cumulative[k * bin_count + middle] > target)
+                        upper = middle;
+                    else
+                        lower = middle + 1;
+                }
+                row[lower]++;
+            }
+        }
+
+        solveWham(&bins, resampled, runs, run_count, j, log_dos, log_z);
+        for (int b = 0; b < beta_count; b++) {
+            for (int h = 0; h < h_count; h++) {
+                double observables[OBSERVABLE_COUNT];
+                reweight(&bins, log_dos, j, ((double *)h_out.data)[h], ((double *)beta_out.data)[b], observables);
+                for (int o = 0; o < OBSERVABLE_COUNT; o++) {
+                    double *mean = &bootstrap_mean[(o * beta_count + b) * h_count + h];
+                    double *m2 = &((double *)error_out[o].data)[b * h_count + h];
+                    double delta = observables[o] - *mean;
+                    *mean += delta / (r + 1);
+                    *m2 += delta * (observables[o] - *mean);
+                }
+            }
+        }
+    }
+    for (int o = 0; o < OBSERVABLE_COUNT; o++)
+        for (int i = 0; i < beta_count * h_count; i++)
+            ((double *)error_out[o].data)[i] = resamples > 1 ? sqrt(((double *)error_out[o].data)[i] / (resamples - 1)) : NAN;
+
+    npy_array_list_t *array_head = npy_array_list_prepend(NULL, &h_out, "h_mu");
+    array_head = array_head ? npy_array_list_prepend(array_head, &beta_out, "beta") : NULL;
+    char error_names[OBSERVABLE_COUNT][64];
+    for (int o = 0; o < OBSERVABLE_COUNT && array_head; o++) {
+        snprintf(error_names[o], sizeof(error_names[o]), "%s_error", observable_names[o]);
+        array_head = npy_array_list_prepend(array_head, &error_out[o], error_names[o]);
+        if (array_head)
+            array_head = npy_array_list_prepend(array_head, &value_out[o], observable_names[o]);
+    }
+    if (!array_head) {
+        fprintf(stderr, "npy_array_list error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (npy_array_list_save(out_filename, array_head) != 2 + 2 * OBSERVABLE_COUNT) {
+        fprintf(stderr, "error saving array list\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return EXIT_SUCCESS;
+}
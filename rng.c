@@ -0,0 +1,47 @@
+#include "rng.h"
+#include "ising.h"
+
+static inline uint64_t rotateLeft(uint64_t a, int k)
+{
+    return (a << k) | (a >> (64 - k));
+}
+
+// Vigna's recommended way of turning one seed into well mixed xoshiro state
+static inline uint64_t splitMix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+void rngSeed(rng_t *rng)
+{
+    for (int word = 0; word < 4; word++)
+        for (int lane = 0; lane < RNG_LANES; lane++)
+            rng->state[word][lane] = splitMix64(xorshift256());
+    rng->position = RNG_BUFFER_LEN;
+}
+
+void rngFill(rng_t *rng)
+{
+    // xoshiro256**, written lane-wise so that the inner loop turns into vector instructions
+    for (int i = 0; i < RNG_BUFFER_LEN; i += RNG_LANES) {
+#pragma omp simd
+        for (int lane = 0; lane < RNG_LANES; lane++) {
+            uint64_t result = rotateLeft(rng->state[1][lane] * 5, 7) * 9;
+            uint64_t temp = rng->state[1][lane] << 17;
+
+            rng->state[2][lane] ^= rng->state[0][lane];
+            rng->state[3][lane] ^= rng->state[1][lane];
+            rng->state[1][lane] ^= rng->state[2][lane];
+            rng->state[0][lane] ^= rng->state[3][lane];
+
+            rng->state[2][lane] ^= temp;
+            rng->state[3][lane] = rotateLeft(rng->state[3][lane], 45);
+
+            rng->buffer[i + lane] = result;
+        }
+    }
+    rng->position = 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+
+#define RNG_LANES 4         // number of interleaved xoshiro256** streams, one per SIMD lane
+#define RNG_BUFFER_LEN 512  // random words generated per refill, a multiple of RNG_LANES
+
+// buffered bulk PRNG for the update kernels. it lives on the caller's stack instead of
+// in a threadprivate global, so the consume functions below inline into the hot loops
+typedef struct {
+    uint64_t buffer[RNG_BUFFER_LEN] __attribute__((aligned(64)));
+    uint64_t state[4][RNG_LANES] __attribute__((aligned(64)));
+    int position;
+} rng_t;
+
+// seeds every lane from the calling thread's xorshift256() stream
+void rngSeed(rng_t *rng);
+
+// steps all of the lanes together to refill the buffer
+void rngFill(rng_t *rng);
+
+static inline uint64_t rngNext(rng_t *rng)
+{
+    if (__builtin_expect(rng->position == RNG_BUFFER_LEN, 0))
+        rngFill(rng);
+    return rng->buffer[rng->position++];
+}
+
+// Lemire's multiply-shift range reduction, uniform on [0, range)
+// the division only happens on the rare path where the result could be biased
+static inline uint32_t rngBounded(rng_t *rng, uint32_t range)
+{
+    uint64_t product = (rngNext(rng) >> 32) * range;
+    uint32_t low = (uint32_t)product;
+    if (__builtin_expect(low < range, 0)) {
+        uint32_t threshold = -range % range;
+        while (low < threshold) {
+            product = (rngNext(rng) >> 32) * range;
+            low = (uint32_t)product;
+        }
+    }
+    return product >> 32;
+}
+
+// the same reduction for 64 bit ranges
+static inline uint64_t rngBounded64(rng_t *rng, uint64_t range)
+{
+    unsigned __int128 product = (unsigned __int128)rngNext(rng) * range;
+    uint64_t low = (uint64_t)product;
+    if (__builtin_expect(low < range, 0)) {
+        uint64_t threshold = -range % range;
+        while (low < threshold) {
+            product = (unsigned __int128)rngNext(rng) * range;
+            low = (uint64_t)product;
+        }
+    }
+    return product >> 64;
+}
+
+// uniform double on [0, 1)
+static inline double rngUniform(rng_t *rng)
+{
+    return (rngNext(rng) >> 11) * 0x1.0p-53;
+}
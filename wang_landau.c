@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "ising.h"
+#include "record.h"
+#include "rng.h"
+#include "parse_args.h"
+
+#define SITE_COUNT (SPACE_LEN * TIME_LEN)
+// with j = 1 and no field the energy is -bondSum(), which moves in steps of 4 from -2N to 2N
+#define LEVEL_COUNT (SITE_COUNT + 1)
+#define SWEEPS_PER_EXCHANGE 16
+
+// energy level index of the energy -bond_sum
+static inline int levelOf(int bond_sum)
+{
+    return (2 * SITE_COUNT - bond_sum) / 4;
+}
+
+// one random walker, restricted to the levels [lower, upper)
+typedef struct {
+    state_t *lattice;
+    int level;
+    int lower;
+    int upper;
+    double log_f;
+    double *log_dos;
+    unsigned long *histogram;
+    unsigned long sweeps;
+} walker_t;
+
+// greedily flips spins until the walker's energy lies inside its window
+void enterWindow(walker_t *walker)
+{
+    while (walker->level < walker->lower || walker->level >= walker->upper) {
+        int x = randomInt(0, SPACE_LEN);
+        int t = randomInt(0, TIME_LEN);
+        int new_level = walker->level + (int)lround(calculateEnergyChange(walker->lattice, 1, 0, x, t)) / 4;
+        int towards = walker->level < walker->lower ? new_level >= walker->level : new_level <= walker->level;
+        if (towards) {
+            flipSpinAt(walker->lattice, x, t);
+            walker->level = new_level;
+        }
+    }
+}
+
+// single spin flip Wang-Landau updates, the walker never leaves its window
+void wangLandau(walker_t *walker, unsigned long iterations)
+{
+    rng_t rng;
+    rngSeed(&rng);
+    for (unsigned long i = 0; i < iterations; i++) {
+        uint32_t site = rngBounded(&rng, SITE_COUNT);
+        int x = site % SPACE_LEN;
+        int t = site / SPACE_LEN;
+        int new_level = walker->level + (int)lround(calculateEnergyChange(walker->lattice, 1, 0, x, t)) / 4;
+
+        if (new_level >= walker->lower && new_level < walker->upper
+                && rngUniform(&rng) <= exp(walker->log_dos[walker->level] - walker->log_dos[new_level])) {
+            flipSpinAt(walker->lattice, x, t);
+            walker->level = new_level;
+        }
+        walker->log_dos[walker->level] += walker->log_f;
+        walker->histogram[walker->level]++;
+    }
+}
+
+// the histogram is flat when every level visited so far has at least
+// flatness times the mean count of the visited levels
+int isFlat(walker_t *walker, double flatness)
+{
+    unsigned long total = 0, min = -1;
+    int visited = 0;
+    for (int e = walker->lower; e < walker->upper; e++) {
+        if (walker->log_dos[e] == 0)
+            continue;
+        total += walker->histogram[e];
+        visited++;
+        if (walker->histogram[e] < min)
+            min = walker->histogram[e];
+    }
+    return visited > 0 && min >= flatness * total / visited;
+}
+
+// swap the configurations of neighbouring windows with the replica exchange acceptance
+void exchangeReplicas(walker_t *a, walker_t *b)
+{
+    if (a->level < b->lower || a->level >= b->upper || b->level < a->lower || b->level >= a->upper)
+        return;
+
+    double log_accept = a->log_dos[a->level] - a->log_dos[b->level] + b->log_dos[b->level] - b->log_dos[a->level];
+    if (uniformFloat() <= exp(log_accept)) {
+        state_t *lattice = a->lattice;
+        a->lattice = b->lattice;
+        b->lattice = lattice;
+        int level = a->level;
+        a->level = b->level;
+        b->level = level;
+    }
+}
+
+// the next level at or above e that window has visited, or upper if there is none
+static int nextVisited(walker_t *walker, int e)
+{
+    while (e < walker->upper && walker->log_dos[e] == 0)
+        e++;
+    return e;
+}
+
+// glue the windows together where the slopes of log g(E) agree best, then normalize to 2^N states.
+// returns 0 on success, or -1 if two neighbouring windows have no pair of visited levels in common
+int joinWindows(walker_t *walkers, int window_count, double *log_dos)
+{
+    for (int e = 0; e < LEVEL_COUNT; e++)
+        log_dos[e] = -INFINITY;
+    for (int e = walkers[0].lower; e < walkers[0].upper; e++)
+        if (walkers[0].log_dos[e] != 0)
+            log_dos[e] = walkers[0].log_dos[e];
+
+    // the joined curve is built from window w - 1 at and above previous_join
+    int previous_join = walkers[0].lower;
+    for (int w = 1; w < window_count; w++) {
+        walker_t *previous = &walkers[w - 1], *current = &walkers[w];
+        int join = -1;
+        double best = INFINITY;
+        int start = current->lower > previous_join ? current->lower : previous_join;
+        for (int e = nextVisited(current, start); e < previous->upper; ) {
+            int next = nextVisited(current, e + 1);
+            if (next >= previous->upper)
+                break;
+            if (previous->log_dos[e] != 0 && previous->log_dos[next] != 0) {
+                double slope_previous = previous->log_dos[next] - previous->log_dos[e];
+                double slope_current = current->log_dos[next] - current->log_dos[e];
+                if (fabs(slope_previous - slope_current) < best) {
+                    best = fabs(slope_previous - slope_current);
+                    join = e;
+                }
+            }
+            e = next;
+        }
+        if (join < 0) {
+            fprintf(stderr, "windows %d and %d have no visited levels in common, increase the overlap\n", w - 1, w);
+            return -1;
+        }
+
+        double shift = log_dos[join] - current->log_dos[join];
+        for (int e = join; e < LEVEL_COUNT; e++)
+            log_dos[e] = -INFINITY;
+        for (int e = join; e < current->upper; e++)
+            if (current->log_dos[e] != 0)
+                log_dos[e] = current->log_dos[e] + shift;
+        previous_join = join;
+    }
+
+    double max = -INFINITY, sum = 0;
+    for (int e = 0; e < LEVEL_COUNT; e++)
+        max = fmax(max, log_dos[e]);
+    for (int e = 0; e < LEVEL_COUNT; e++)
+        sum += exp(log_dos[e] - max);
+    double offset = SITE_COUNT * M_LN2 - max - log(sum);
+    for (int e = 0; e < LEVEL_COUNT; e++)
+        log_dos[e] += offset;
+    return 0;
+}
+
+// saves every window's unjoined log g(E) as rows of E / j followed by one column per window,
+// NAN where the window never went, so a run that can't be joined isn't lost
+void saveWindows(walker_t *walkers, int window_count, const char *filename)
+{
+    npy_array_t windows_out = createNpyDoubleArrayNd(2, LEVEL_COUNT, window_count + 1);
+    double *rows = (double *)windows_out.data;
+    for (int e = 0; e < LEVEL_COUNT; e++) {
+        *rows++ = 4 * e - 2 * SITE_COUNT;
+        for (int w = 0; w < window_count; w++) {
+            int inside = e >= walkers[w].lower && e < walkers[w].upper && walkers[w].log_dos[e] != 0;
+            *rows++ = inside ? walkers[w].log_dos[e] : NAN;
+        }
+    }
+    npy_array_save(filename, &windows_out);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 6) {
+        fprintf(stderr, "usage: %s <windows> <overlap> <flatness> <final ln f> <outfile>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int window_count = parseUnsignedLong(argv[1], "windows");
+    double overlap   = parseDouble(argv[2], "overlap");
+    double flatness  = parseDouble(argv[3], "flatness");
+    double final_log_f = parseDouble(argv[4], "final ln f");
+    char *filename = argv[5];
+
+    if (window_count < 1 || overlap < 0 || overlap >= 1) {
+        fprintf(stderr, "need at least one window and an overlap in [0, 1)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // windows of equal width, each one overlapping the next by the given fraction
+    double width = LEVEL_COUNT / (1 + (window_count - 1) * (1 - overlap));
+    walker_t walkers[window_count];
+    for (int w = 0; w < window_count; w++) {
+        walkers[w] = (walker_t) {
+            .lattice = calloc(TIME_LEN * SPACE_STATE_COUNT, sizeof(state_t)),
+            .lower = (int)(w * width * (1 - overlap)),
+            .upper = w == window_count - 1 ? LEVEL_COUNT : (int)(w * width * (1 - overlap) + width),
+            .log_f = 1,
+            .log_dos = calloc(LEVEL_COUNT, sizeof(double)),
+            .histogram = calloc(LEVEL_COUNT, sizeof(unsigned long)),
+        };
+        if (!walkers[w].lattice || !walkers[w].log_dos || !walkers[w].histogram) {
+            fprintf(stderr, "Error allocating walkers, abort!\n");
+            exit(EXIT_FAILURE);
+        }
+        // the join compares the slope between two levels that both windows cover,
+        // so find out now instead of after the whole run
+        if (w > 0 && walkers[w - 1].upper - walkers[w].lower < 2) {
+            fprintf(stderr, "windows %d and %d share %d energy levels, at least 2 are needed, increase the overlap\n",
+                    w - 1, w, walkers[w - 1].upper - walkers[w].lower);
+            exit(EXIT_FAILURE);
+        }
+        // all down is the bottom of the spectrum and the checkerboard is the top,
+        // start from whichever is nearer
+        if (walkers[w].lower + walkers[w].upper > LEVEL_COUNT)
+            for (int t = 0; t < TIME_LEN; t++)
+                for (int x = 0; x < SPACE_LEN; x++)
+                    if ((x + t) % 2)
+                        flipSpinAt(walkers[w].lattice, x, t);
+        walkers[w].level = levelOf(bondSum(walkers[w].lattice));
+    }
+
+    int all_done = 0;
+    unsigned long round = 0;
+
+#pragma omp threadprivate(xorshift_state)
+#pragma omp parallel num_threads(window_count)
+    {
+        for (int i = 0; i < omp_get_thread_num(); i++)
+            jump();
+
+        // a thread runs several windows when the runtime grants fewer threads than windows
+#pragma omp for
+        for (int w = 0; w < window_count; w++)
+            enterWindow(&walkers[w]);
+
+        while (!all_done) {
+#pragma omp for
+            for (int w = 0; w < window_count; w++) {
+                walker_t *walker = &walkers[w];
+                if (walker->log_f < final_log_f)
+                    continue;
+                wangLandau(walker, SWEEPS_PER_EXCHANGE * SITE_COUNT);
+                walker->sweeps += SWEEPS_PER_EXCHANGE;
+                if (isFlat(walker, flatness)) {
+                    walker->log_f /= 2;
+                    memset(walker->histogram, 0, LEVEL_COUNT * sizeof(unsigned long));
+                    printf("window %d: ln f = %g after %lu sweeps\n", w, walker->log_f, walker->sweeps);
+                }
+            }
+#pragma omp single
+            {
+                // alternate between the even and odd pairs of windows
+                for (int w = round % 2; w + 1 < window_count; w += 2)
+                    if (walkers[w].log_f >= final_log_f && walkers[w + 1].log_f >= final_log_f)
+                        exchangeReplicas(&walkers[w], &walkers[w + 1]);
+                round++;
+
+                all_done = 1;
+                for (int w = 0; w < window_count; w++)
+                    all_done &= walkers[w].log_f < final_log_f;
+            }
+        }
+    }
+
+    // only the visited levels are written, as rows of E / j, ln g(E)
+    double log_dos[LEVEL_COUNT];
+    if (joinWindows(walkers, window_count, log_dos)) {
+        char windows_filename[strlen(filename) + 16];
+        sprintf(windows_filename, "%s.windows", filename);
+        saveWindows(walkers, window_count, windows_filename);
+        fprintf(stderr, "saved the unjoined windows to %s\n", windows_filename);
+        exit(EXIT_FAILURE);
+    }
+    int visited = 0;
+    for (int e = 0; e < LEVEL_COUNT; e++)
+        visited += log_dos[e] != -INFINITY;
+
+    npy_array_t dos_out = createNpyDoubleArrayNd(2, visited, 2);
+    double *rows = (double *)dos_out.data;
+    for (int e = 0; e < LEVEL_COUNT; e++) {
+        if (log_dos[e] == -INFINITY)
+            continue;
+        *rows++ = 4 * e - 2 * SITE_COUNT;
+        *rows++ = log_dos[e];
+    }
+    npy_array_save(filename, &dos_out);
+
+    for (int w = 0; w < window_count; w++) {
+        free(walkers[w].lattice);
+        free(walkers[w].log_dos);
+        free(walkers[w].histogram);
+    }
+    return EXIT_SUCCESS;
+}
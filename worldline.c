@@ -0,0 +1,215 @@
+#include "worldline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static void *resizeOrDie(void *array, size_t size)
+{
+    array = realloc(array, size);
+    if (!array) {
+        fprintf(stderr, "Error allocating worldlines, abort!\n");
+        exit(EXIT_FAILURE);
+    }
+    return array;
+}
+
+void worldlinesInit(worldlines_t *worldlines, double beta)
+{
+    memset(worldlines, 0, sizeof(worldlines_t));
+    worldlines->beta = beta;
+    for (int x = 0; x < SPACE_LEN; x++)
+        worldlines->start_spins[x] = 1;
+}
+
+void worldlinesFree(worldlines_t *worldlines)
+{
+    free(worldlines->kinks);
+    free(worldlines->piece_starts);
+    free(worldlines->piece_spins);
+    free(worldlines->cluster_flips);
+    free(worldlines->parents);
+    free(worldlines->cluster_weights);
+    free(worldlines->new_kinks);
+}
+
+// union find with path halving
+static inline size_t findRoot(size_t *parents, size_t i)
+{
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+static inline double exponentialTime(rng_t *rng, double rate)
+{
+    return rate > 0 ? -log(1 - rngUniform(rng)) / rate : INFINITY;
+}
+
+// adds a piece starting at time start, growing every piece array together
+static inline void addPiece(worldlines_t *worldlines, size_t *piece_count, double start, spin_t spin)
+{
+    if (*piece_count == worldlines->piece_capacity) {
+        size_t capacity = worldlines->piece_capacity ? 2 * worldlines->piece_capacity : 256;
+        worldlines->piece_starts    = resizeOrDie(worldlines->piece_starts, capacity * sizeof(double));
+        worldlines->piece_spins     = resizeOrDie(worldlines->piece_spins, capacity * sizeof(int8_t));
+        worldlines->cluster_flips   = resizeOrDie(worldlines->cluster_flips, capacity * sizeof(int8_t));
+        worldlines->parents         = resizeOrDie(worldlines->parents, capacity * sizeof(size_t));
+        worldlines->cluster_weights = resizeOrDie(worldlines->cluster_weights, capacity * sizeof(double));
+        worldlines->piece_capacity = capacity;
+    }
+    worldlines->piece_starts[*piece_count] = start;
+    worldlines->piece_spins[*piece_count] = spin;
+    worldlines->parents[*piece_count] = *piece_count;
+    (*piece_count)++;
+}
+
+// the end of piece i, which is the start of the next piece on the same site or beta
+static inline double pieceEnd(worldlines_t *worldlines, int x, size_t i)
+{
+    return i + 1 < worldlines->piece_offsets[x + 1] ? worldlines->piece_starts[i + 1] : worldlines->beta;
+}
+
+void clusterUpdate(worldlines_t *worldlines, rng_t *rng, double j, double gamma, double h_mu)
+{
+    double beta = worldlines->beta;
+
+    // cut every worldline at its kinks and at a Poisson process of rate gamma
+    size_t piece_count = 0;
+    for (int x = 0; x < SPACE_LEN; x++) {
+        worldlines->piece_offsets[x] = piece_count;
+        spin_t spin = worldlines->start_spins[x];
+        addPiece(worldlines, &piece_count, 0, spin);
+
+        size_t k = worldlines->offsets[x];
+        double cut = exponentialTime(rng, gamma);
+        for (;;) {
+            double kink = k < worldlines->offsets[x + 1] ? worldlines->kinks[k] : INFINITY;
+            if (kink >= beta && cut >= beta)
+                break;
+            if (kink <= cut) {
+                spin = -spin;
+                addPiece(worldlines, &piece_count, kink, spin);
+                k++;
+            }
+            else {
+                addPiece(worldlines, &piece_count, cut, spin);
+                cut += exponentialTime(rng, gamma);
+            }
+        }
+    }
+    worldlines->piece_offsets[SPACE_LEN] = piece_count;
+    size_t *parents = worldlines->parents;
+
+    // time is periodic, so the first and last pieces of a worldline are the same segment
+    for (int x = 0; x < SPACE_LEN; x++) {
+        size_t first = worldlines->piece_offsets[x], last = worldlines->piece_offsets[x + 1] - 1;
+        if (first != last)
+            parents[last] = first;
+    }
+
+    // bond overlapping pieces of neighbouring worldlines that lower the energy, at rate 2 |j|
+    double bond_rate = 2 * fabs(j);
+    int bond_sign = j > 0 ? 1 : -1;
+    for (int x = 0; x < SPACE_LEN; x++) {
+        int neighbour = (x + 1) % SPACE_LEN;
+        size_t a = worldlines->piece_offsets[x], b = worldlines->piece_offsets[neighbour];
+        while (a < worldlines->piece_offsets[x + 1] && b < worldlines->piece_offsets[neighbour + 1]) {
+            double a_end = pieceEnd(worldlines, x, a), b_end = pieceEnd(worldlines, neighbour, b);
+            if (worldlines->piece_spins[a] * worldlines->piece_spins[b] * bond_sign > 0) {
+                size_t root_a = findRoot(parents, a), root_b = findRoot(parents, b);
+                double overlap = fmin(a_end, b_end) - fmax(worldlines->piece_starts[a], worldlines->piece_starts[b]);
+                if (root_a != root_b && rngUniform(rng) < -expm1(-bond_rate * overlap))
+                    parents[root_a] = root_b;
+            }
+            if (a_end <= b_end)
+                a++;
+            else
+                b++;
+        }
+    }
+
+    // heat bath for the spin of every cluster, from the time integral of its spin
+    for (size_t i = 0; i < piece_count; i++) {
+        worldlines->cluster_weights[i] = 0;
+        worldlines->cluster_flips[i] = -1;
+    }
+    for (int x = 0; x < SPACE_LEN; x++)
+        for (size_t i = worldlines->piece_offsets[x]; i < worldlines->piece_offsets[x + 1]; i++)
+            worldlines->cluster_weights[findRoot(parents, i)] += worldlines->piece_spins[i]
+                * (pieceEnd(worldlines, x, i) - worldlines->piece_starts[i]);
+
+    // rebuild the kinks into the second arena, then swap the arenas over
+    // there can't be more kinks than pieces
+    if (worldlines->new_kink_capacity < piece_count) {
+        worldlines->new_kinks = resizeOrDie(worldlines->new_kinks, piece_count * sizeof(double));
+        worldlines->new_kink_capacity = piece_count;
+    }
+    size_t kink_count = 0;
+    for (int x = 0; x < SPACE_LEN; x++) {
+        worldlines->offsets[x] = kink_count;
+        spin_t previous = 0;
+        for (size_t i = worldlines->piece_offsets[x]; i < worldlines->piece_offsets[x + 1]; i++) {
+            size_t root = findRoot(parents, i);
+            if (worldlines->cluster_flips[root] < 0) {
+                double flip_probability = 1 / (1 + exp(2 * h_mu * worldlines->cluster_weights[root]));
+                worldlines->cluster_flips[root] = rngUniform(rng) < flip_probability;
+            }
+            spin_t spin = worldlines->cluster_flips[root] ? -worldlines->piece_spins[i] : worldlines->piece_spins[i];
+            if (i == worldlines->piece_offsets[x])
+                worldlines->start_spins[x] = spin;
+            else if (spin != previous)
+                worldlines->new_kinks[kink_count++] = worldlines->piece_starts[i];
+            previous = spin;
+        }
+    }
+    worldlines->offsets[SPACE_LEN] = kink_count;
+
+    double *kinks = worldlines->kinks;
+    size_t kink_capacity = worldlines->kink_capacity;
+    worldlines->kinks = worldlines->new_kinks;
+    worldlines->kink_capacity = worldlines->new_kink_capacity;
+    worldlines->new_kinks = kinks;
+    worldlines->new_kink_capacity = kink_capacity;
+}
+
+void worldlinesToLattice(worldlines_t *worldlines, state_t *lattice)
+{
+    memset(lattice, 0, TIME_LEN * SPACE_STATE_COUNT * sizeof(state_t));
+    for (int x = 0; x < SPACE_LEN; x++) {
+        size_t k = worldlines->offsets[x];
+        spin_t spin = worldlines->start_spins[x];
+        for (int t = 0; t < TIME_LEN; t++) {
+            double time = (t + 0.5) * worldlines->beta / TIME_LEN;
+            while (k < worldlines->offsets[x + 1] && worldlines->kinks[k] <= time) {
+                spin = -spin;
+                k++;
+            }
+            if (spin > 0)
+                lattice[x / SPINS_PER_STATE_T + t * SPACE_STATE_COUNT] |= (state_t)1 << (x % SPINS_PER_STATE_T);
+        }
+    }
+}
+
+double worldlinesMagnetization(worldlines_t *worldlines)
+{
+    double total = 0;
+    for (int x = 0; x < SPACE_LEN; x++) {
+        spin_t spin = worldlines->start_spins[x];
+        double previous = 0;
+        for (size_t k = worldlines->offsets[x]; k < worldlines->offsets[x + 1]; k++) {
+            total += spin * (worldlines->kinks[k] - previous);
+            previous = worldlines->kinks[k];
+            spin = -spin;
+        }
+        total += spin * (worldlines->beta - previous);
+    }
+    return total / worldlines->beta;
+}
+
+size_t worldlinesKinkCount(worldlines_t *worldlines)
+{
+    return worldlines->offsets[SPACE_LEN];
+}
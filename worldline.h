@@ -0,0 +1,51 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "ising.h"
+#include "rng.h"
+
+// continuous imaginary time version of the lattice: the space direction is still SPACE_LEN
+// sites, but instead of TIME_LEN slices each site's worldline on [0, beta) is stored as its
+// spin at time 0 plus the sorted times of its kinks (domain walls along time). the model is
+//   H = -j sum s_x s_x+1 - gamma sum sigma^x_x - h_mu sum s_x
+// which is the TIME_LEN -> infinity limit of the anisotropic classical lattice with
+//   K_space = beta * j / TIME_LEN, K_time = -log(tanh(beta * gamma / TIME_LEN)) / 2
+typedef struct {
+    double beta;                      // extent of the time direction
+    spin_t start_spins[SPACE_LEN];    // spin of each site at time 0
+    size_t offsets[SPACE_LEN + 1];    // site x owns kinks[offsets[x]] up to kinks[offsets[x + 1]]
+    double *kinks;                    // arena with every site's sorted kink times back to back
+    size_t kink_capacity;
+
+    // scratch space for clusterUpdate(), kept between updates so it is only ever grown
+    size_t piece_offsets[SPACE_LEN + 1];
+    size_t piece_capacity;
+    double *piece_starts;
+    int8_t *piece_spins;
+    int8_t *cluster_flips;
+    size_t *parents;
+    double *cluster_weights;
+    double *new_kinks;
+    size_t new_kink_capacity;
+} worldlines_t;
+
+// every spin up and no kinks
+void worldlinesInit(worldlines_t *worldlines, double beta);
+
+void worldlinesFree(worldlines_t *worldlines);
+
+// one continuous time Swendsen-Wang update (Rieger and Kawashima). each worldline is cut
+// at its kinks and at Poisson distributed points with rate gamma, parallel overlapping
+// pieces of neighbouring sites are bonded with probability 1 - exp(-2 |j| overlap) and
+// every cluster then picks its spin with a heat bath in the longitudinal field h_mu
+void clusterUpdate(worldlines_t *worldlines, rng_t *rng, double j, double gamma, double h_mu);
+
+// samples the worldlines at the middle of each of the TIME_LEN slices, giving a lattice
+// in the packed format that writeState() expects
+void worldlinesToLattice(worldlines_t *worldlines, state_t *lattice);
+
+// integral of the total spin over time, divided by beta
+double worldlinesMagnetization(worldlines_t *worldlines);
+
+// total number of kinks, -gamma <sigma^x> per site is this over beta * SPACE_LEN
+size_t worldlinesKinkCount(worldlines_t *worldlines);